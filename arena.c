@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* every allocation is rounded up to this alignment */
+#define ARENA_ALIGN 16
+
+/* Carve `size` bytes out of chunk `c`, or return NULL if they do not fit */
+static void *bump(ArenaChunk *c, size_t size) {
+    uintptr_t at = (uintptr_t)(c->data + c->used);
+    size_t pad = (size_t)(-at & (ARENA_ALIGN - 1));
+    if (c->size - c->used < pad + size) return NULL;
+    c->used += pad + size;
+    return (char *)at + pad;
+}
+
+static ArenaChunk *new_chunk(size_t size) {
+    /* room for the worst-case alignment padding of the first allocation */
+    size += ARENA_ALIGN;
+    ArenaChunk *c = malloc(sizeof(ArenaChunk) + size);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void arena_init(Arena *a, size_t chunk_size) {
+    a->first = NULL;
+    a->current = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+    a->allocated = 0;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    if (size == 0) size = 1;
+    a->allocated += size;
+
+    ArenaChunk *c = a->current;
+    void *p = c ? bump(c, size) : NULL;
+    if (p) return p;
+
+    /* move on to a chunk left over from before the last reset, if it fits */
+    ArenaChunk *next = c ? c->next : a->first;
+    if (next && next->size >= size + ARENA_ALIGN) {
+        next->used = 0;
+    } else {
+        size_t want = size > a->chunk_size ? size : a->chunk_size;
+        ArenaChunk *fresh = new_chunk(want);
+        if (!fresh) return NULL;
+        /* splice in before any leftover chunk so it stays reusable */
+        fresh->next = next;
+        if (c) c->next = fresh;
+        else   a->first = fresh;
+        next = fresh;
+    }
+    a->current = next;
+    return bump(next, size);
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t len) {
+    char *p = arena_alloc(a, len + 1);
+    if (!p) return NULL;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+void arena_reset(Arena *a) {
+    a->current = a->first;
+    if (a->first) a->first->used = 0;
+}
+
+void arena_adopt(Arena *dst, Arena *src) {
+    dst->allocated += src->allocated;
+    src->allocated = 0;
+    if (!src->first) return;
+    ArenaChunk *last = src->first;
+    while (last->next) last = last->next;
+    /* in front of dst's current chunk, so arena_alloc never takes them for
+     * leftovers and bumps over them */
+    last->next = dst->first;
+    dst->first = src->first;
+    if (!dst->current) dst->current = last;
+    src->first = NULL;
+    src->current = NULL;
+}
+
+void arena_free(Arena *a) {
+    ArenaChunk *c = a->first;
+    while (c) {
+        ArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->first = NULL;
+    a->current = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Default size of each block the arena takes from malloc */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* One block of arena memory; chunks form a singly linked list */
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t             size;   /* usable bytes in data[] */
+    size_t             used;
+    char               data[];
+} ArenaChunk;
+
+/*
+ * Bump allocator owned by one assembly.  Individual allocations are never
+ * freed; arena_reset() makes all of the memory available again in O(1)
+ * while keeping the chunks, so assembling many files reuses the same blocks
+ * instead of returning them to libc.
+ */
+typedef struct {
+    ArenaChunk *first;
+    ArenaChunk *current;
+    size_t      chunk_size;
+    size_t      allocated;   /* bytes handed out since arena_init(), across resets */
+} Arena;
+
+/* Initialise an empty arena (chunk_size 0 selects ARENA_CHUNK_SIZE) */
+void  arena_init(Arena *a, size_t chunk_size);
+
+/* Allocate `size` bytes aligned for any type. Returns NULL if out of memory. */
+void *arena_alloc(Arena *a, size_t size);
+
+/* Copy `len` bytes of `s` into the arena and NUL-terminate the copy */
+char *arena_strndup(Arena *a, const char *s, size_t len);
+char *arena_strdup(Arena *a, const char *s);
+
+/* Forget every allocation but keep the chunks for reuse */
+void  arena_reset(Arena *a);
+
+/* Move every chunk of `src` into `dst`, leaving `src` empty.  What was
+ * allocated from `src` stays valid until `dst` is reset or freed, and
+ * counts as allocated from `dst`. */
+void  arena_adopt(Arena *dst, Arena *src);
+
+/* Return all chunks to the system */
+void  arena_free(Arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "assemble.h"
+#include "macro.h"
+#include "parser.h"
+#include "second_pass.h"
+#include "data_segment.h"
+#include "error.h"
+#include "stats.h"
+
+/* What the assembly's arenas have handed out so far, for --stats */
+static size_t arena_bytes(const Arena *arena, const Arena *scratch) {
+    return arena->allocated + scratch->allocated;
+}
+
+bool assemble_lines(const LineView *lines, int line_count,
+                    Arena *arena, Arena *scratch, Assembly *out) {
+    bool ok = false;
+    LineView *flat = NULL; int flat_n = 0;
+    MacroTable mt; init_macro_table(&mt, scratch);
+    ParsedLine *plarr = NULL;
+    DataSegment data_seg; init_data_segment(&data_seg);
+    CPUState cpu = {0};
+    int IC = 0, DC = 0;
+    ErrorSink *diag = error_bound_sink();
+    StatMark mark;
+
+    memset(out, 0, sizeof(*out));
+    init_symbol_table(&out->symtab, arena);
+
+    stats_count(STAT_LINES, line_count);
+    stats_begin(&mark, arena_bytes(arena, scratch));
+    bool scanned = scan_macros(lines, line_count, &mt);
+    stats_end(&mark, PHASE_SCAN_MACROS, arena_bytes(arena, scratch));
+    if (!scanned) goto cleanup;
+
+    stats_begin(&mark, arena_bytes(arena, scratch));
+    flat = expand_macros(lines, line_count, &flat_n, &mt);
+    stats_end(&mark, PHASE_EXPAND_MACROS,
+              arena_bytes(arena, scratch) + sizeof(*flat) * flat_n);
+
+    /* every line is parsed exactly once, into the array both passes share */
+    plarr = arena_alloc(arena, sizeof(*plarr) * (flat_n ? flat_n : 1));
+    if (!plarr) goto cleanup;
+
+    stats_begin(&mark, arena_bytes(arena, scratch));
+    bool first_ok = first_pass(flat, flat_n, plarr, arena, &out->symtab, &IC, &DC, &data_seg);
+    stats_end(&mark, PHASE_FIRST_PASS, arena_bytes(arena, scratch));
+    if (stats_enabled) {
+        int statements = 0;
+        for (int i = 0; i < flat_n; i++) statements += plarr[i].type != STMT_EMPTY;
+        stats_count(STAT_STATEMENTS, statements);
+    }
+    /* what is reported from here on is about the whole file */
+    error_sink_at(diag, 0);
+
+    /* the parsed array owns everything from here on: drop the text */
+    free(flat); flat = NULL;
+    free_macro_table(&mt);
+    arena_reset(scratch);
+
+    if (!first_ok) {
+        print_error("First pass failed");
+        goto cleanup;
+    }
+
+    stats_begin(&mark, arena_bytes(arena, scratch));
+    cpu.memory = arena_alloc(arena, sizeof(uint16_t) * (IC ? IC : 1));
+    cpu.PC = 0;
+    cpu.symtab = &out->symtab;
+    cpu.arena = arena;
+    if (!cpu.memory) goto cleanup;
+    memset(cpu.memory, 0, sizeof(uint16_t) * (IC ? IC : 1));
+
+    bool second_ok = second_pass(plarr, flat_n, &cpu);
+    stats_end(&mark, PHASE_SECOND_PASS, arena_bytes(arena, scratch));
+    error_sink_at(diag, 0);
+    if (!second_ok) {
+        print_error("Second pass failed");
+        goto cleanup;
+    }
+
+    if (data_seg.count != DC) {
+        print_error("Data count mismatch");
+    }
+
+    out->data = arena_alloc(arena, sizeof(uint16_t) * (DC ? DC : 1));
+    if (!out->data) goto cleanup;
+    int have = data_seg.count < DC ? data_seg.count : DC;
+    if (have) memcpy(out->data, data_seg.words, sizeof(uint16_t) * have);
+    memset(out->data + have, 0, sizeof(uint16_t) * (DC - have));
+    out->data_count = DC;
+    out->code = cpu.memory;
+    out->code_count = IC;
+    out->ext_uses = cpu.ext_uses;
+    stats_count(STAT_WORDS_EMITTED, IC + DC);
+    ok = true;
+
+cleanup:
+    free_data_segment(&data_seg);
+    free_macro_table(&mt);
+    free(flat);
+    arena_reset(scratch);
+    return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef ASSEMBLE_H
+#define ASSEMBLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arena.h"
+#include "source.h"
+#include "symbol_table.h"
+
+/* Everything one assembly produces, held in the assembly's arena */
+typedef struct {
+    uint16_t    *code;        /* code image, code_count words */
+    int          code_count;
+    uint16_t    *data;        /* data image, data_count words */
+    int          data_count;
+    SymbolTable  symtab;      /* final symbols; .entry ones are SYM_ENTRY */
+    ExternalUse *ext_uses;    /* uses of external symbols, newest first */
+} Assembly;
+
+/*
+ * Expand macros in `lines` and run both passes.  The results live in
+ * `arena` until the caller resets it; `scratch` is used for macro text and
+ * is reset before returning.  Diagnostics go through print_error.  Returns
+ * false if the source has errors.  The lines are not touched once this
+ * returns.
+ */
+bool assemble_lines(const LineView *lines, int line_count,
+                    Arena *arena, Arena *scratch, Assembly *out);
+
+#endif /* ASSEMBLE_H */
@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "error.h"
+#include "utils.h"
+
+/* One file of the batch and its outcome */
+typedef struct {
+    const char *path;
+    long long   size;     /* scheduling weight */
+    bool        ok;
+    bool        done;
+    ErrorSink   diag;     /* diagnostics, flushed in argv order */
+    Stats       stats;    /* --stats counts, merged in argv order */
+} Job;
+
+/* A worker's share of the jobs: it takes from the front, thieves from the back */
+typedef struct {
+    int            *items;  /* job indices, largest first */
+    int             head;
+    int             tail;
+    pthread_mutex_t lock;
+} Deque;
+
+typedef struct Pool Pool;
+
+typedef struct {
+    Pool *pool;
+    int   id;
+} Worker;
+
+struct Pool {
+    Job            *jobs;
+    Deque          *deques;
+    int             nworkers;
+    AssembleFn      assemble;
+    pthread_mutex_t done_lock;
+    pthread_cond_t  done_cond;
+};
+
+/* Run one job on the calling thread with its own diagnostics sink and
+ * stats; `worker` is the thread's lane in the trace */
+static void run_job(Job *job, AssembleFn assemble, Arena *arena, Arena *scratch, int worker) {
+    StatMark mark;
+    error_bind_sink(&job->diag);
+    stats_bind(&job->stats);
+    job->stats.tid = worker;
+    stats_begin(&mark, 0);
+    worker_job_begin();
+    job->ok = assemble(job->path, arena, scratch);
+    worker_job_end();
+    stats_file_done(&mark, job->path);
+    stats_bind(NULL);
+    error_bind_sink(NULL);
+}
+
+static bool take_front(Deque *d, int *job) {
+    bool found = false;
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) {
+        *job = d->items[d->head++];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static bool steal_back(Deque *d, int *job) {
+    bool found = false;
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) {
+        *job = d->items[--d->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/* Own deque first; when it is empty, steal from the others in turn */
+static bool next_job(Pool *pool, int self, int *job) {
+    if (take_front(&pool->deques[self], job)) return true;
+    for (int k = 1; k < pool->nworkers; k++) {
+        int victim = (self + k) % pool->nworkers;
+        if (steal_back(&pool->deques[victim], job)) return true;
+    }
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    Arena arena, scratch;
+    arena_init(&arena, 0);
+    arena_init(&scratch, 0);
+
+    int j;
+    while (next_job(pool, w->id, &j)) {
+        run_job(&pool->jobs[j], pool->assemble, &arena, &scratch, w->id);
+        pthread_mutex_lock(&pool->done_lock);
+        pool->jobs[j].done = true;
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+
+    arena_free(&arena);
+    arena_free(&scratch);
+    return NULL;
+}
+
+/* qsort context is not available in C99, so sort (size, index) pairs */
+typedef struct {
+    long long size;
+    int       index;
+} SizeKey;
+
+static int by_size_desc(const void *a, const void *b) {
+    const SizeKey *x = a, *y = b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x->index - y->index;
+}
+
+/* Serial path: same buffering, so the output is identical to -j N */
+static bool run_serial(Job *jobs, int count, AssembleFn assemble) {
+    Arena arena, scratch;
+    arena_init(&arena, 0);
+    arena_init(&scratch, 0);
+    bool all_ok = true;
+    for (int i = 0; i < count; i++) {
+        run_job(&jobs[i], assemble, &arena, &scratch, 0);
+        error_sink_flush(&jobs[i].diag, stderr);
+        all_ok = all_ok && jobs[i].ok;
+    }
+    arena_free(&arena);
+    arena_free(&scratch);
+    return all_ok;
+}
+
+static bool run_parallel(Job *jobs, int count, int nworkers, AssembleFn assemble) {
+    Pool pool;
+    pool.jobs = jobs;
+    pool.nworkers = nworkers;
+    pool.assemble = assemble;
+    pthread_mutex_init(&pool.done_lock, NULL);
+    pthread_cond_init(&pool.done_cond, NULL);
+
+    SizeKey *order = malloc(sizeof(*order) * count);
+    int *items = malloc(sizeof(*items) * count);
+    pool.deques = malloc(sizeof(*pool.deques) * nworkers);
+    Worker *workers = malloc(sizeof(*workers) * nworkers);
+    pthread_t *threads = malloc(sizeof(*threads) * nworkers);
+    if (!order || !items || !pool.deques || !workers || !threads)
+        error_exit("Memory allocation failed");
+
+    for (int i = 0; i < count; i++) {
+        order[i].size = jobs[i].size;
+        order[i].index = i;
+    }
+    qsort(order, count, sizeof(*order), by_size_desc);
+
+    /* deal the sorted jobs round-robin so every deque is largest-first */
+    int next = 0;
+    for (int w = 0; w < nworkers; w++) {
+        Deque *d = &pool.deques[w];
+        d->items = items + next;
+        d->head = 0;
+        d->tail = 0;
+        for (int i = w; i < count; i += nworkers)
+            d->items[d->tail++] = order[i].index;
+        next += d->tail;
+        pthread_mutex_init(&d->lock, NULL);
+    }
+
+    /* deques of workers that fail to start are drained by stealing */
+    int started = 0;
+    for (int w = 0; w < nworkers; w++) {
+        workers[w].pool = &pool;
+        workers[w].id = w;
+        if (pthread_create(&threads[started], NULL, worker_main, &workers[w]) == 0)
+            started++;
+    }
+    if (started == 0)
+        worker_main(&workers[0]);   /* no threads at all: work inline */
+
+    /* report each file as soon as it and every file before it are done */
+    bool all_ok = true;
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&pool.done_lock);
+        while (!jobs[i].done)
+            pthread_cond_wait(&pool.done_cond, &pool.done_lock);
+        pthread_mutex_unlock(&pool.done_lock);
+        error_sink_flush(&jobs[i].diag, stderr);
+        all_ok = all_ok && jobs[i].ok;
+    }
+
+    for (int w = 0; w < started; w++)
+        pthread_join(threads[w], NULL);
+    for (int w = 0; w < nworkers; w++)
+        pthread_mutex_destroy(&pool.deques[w].lock);
+    pthread_mutex_destroy(&pool.done_lock);
+    pthread_cond_destroy(&pool.done_cond);
+    free(threads);
+    free(workers);
+    free(pool.deques);
+    free(items);
+    free(order);
+    return all_ok;
+}
+
+bool assemble_batch(char *const files[], int count, int jobs, AssembleFn assemble,
+                    const DiagOptions *diag, Stats *stats) {
+    Job *list = calloc(count ? count : 1, sizeof(*list));
+    if (!list) error_exit("Memory allocation failed");
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        list[i].path = files[i];
+        list[i].size = stat(files[i], &st) == 0 ? (long long)st.st_size : 0;
+        error_sink_init(&list[i].diag);
+        error_sink_configure(&list[i].diag, files[i], diag);
+        stats_init(&list[i].stats);
+    }
+
+    if (jobs > count) jobs = count;
+    bool ok = jobs <= 1 ? run_serial(list, count, assemble)
+                        : run_parallel(list, count, jobs, assemble);
+
+    for (int i = 0; i < count; i++) {
+        if (stats) stats_merge(stats, &list[i].stats);
+        stats_free(&list[i].stats);
+        error_sink_free(&list[i].diag);
+    }
+    free(list);
+    return ok;
+}
+
+bool read_manifest(const char *manifest, char ***files, int *count, int *cap) {
+    FILE *f = fopen(manifest, "r");
+    if (!f) { print_system_error(manifest); return false; }
+
+    char *line = NULL;
+    size_t linecap = 0;
+    while (getline(&line, &linecap, f) != -1) {
+        trim_string(line);
+        if (line[0] == '\0') continue;
+        if (*count >= *cap) {
+            *cap = *cap ? *cap * 2 : 64;
+            char **tmp = realloc(*files, sizeof(char*) * *cap);
+            if (!tmp) error_exit("Memory allocation failed");
+            *files = tmp;
+        }
+        (*files)[*count] = strdup(line);
+        if (!(*files)[*count]) error_exit("Memory allocation failed");
+        (*count)++;
+    }
+    free(line);
+    fclose(f);
+    return true;
+}
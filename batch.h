@@ -0,0 +1,31 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include "arena.h"
+#include "error.h"
+#include "stats.h"
+
+/* Assembles one file using the given per-worker arenas */
+typedef bool (*AssembleFn)(const char *fname, Arena *arena, Arena *scratch);
+
+/*
+ * Assemble `count` files with up to `jobs` threads.  Files are scheduled
+ * largest first onto per-worker deques and idle workers steal from the
+ * others.  Each file's diagnostics are buffered in a sink set up with
+ * `diag` (may be NULL) and written to stderr in the order the files were
+ * given, so the output and the result match a serial run.  With
+ * stats_enabled, each file's timings and counters are added to `stats`
+ * (may be NULL) in the same order.  Returns true only if every file
+ * assembled.
+ */
+bool assemble_batch(char *const files[], int count, int jobs, AssembleFn assemble,
+                    const DiagOptions *diag, Stats *stats);
+
+/*
+ * Append the paths listed in `manifest` (one per line; blank lines are
+ * skipped) to the growing array *files.  Returns false if it can't be read.
+ */
+bool read_manifest(const char *manifest, char ***files, int *count, int *cap);
+
+#endif /* BATCH_H */
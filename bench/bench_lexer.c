@@ -0,0 +1,123 @@
+/*
+ * Front-end throughput: split a source file (or a generated one) into
+ * lines, lex and fully parse every line, repeatedly, and report MB/s.
+ *
+ *     ./bench_lexer [file.as]
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "scan.h"
+#include "parser.h"
+#include "source.h"
+#include "error.h"
+
+#define MIN_BYTES (64u << 20)   /* lex at least this much per measurement */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A source with the usual mix of statements, comments and blank lines */
+static char *generate(size_t *size) {
+    static const char *const lines[] = {
+        "MAIN:   mov r3, LENGTH",
+        "LOOP:   jmp L1",
+        "        prn #-5",
+        "        mov M1[r2][r7], r3     ; copy an element",
+        "        sub r1, r4",
+        "        bne END",
+        "",
+        "; a comment line",
+        "STR:    .string \"abcdef\"",
+        "LENGTH: .data 6,-9,15",
+        "M1:     .mat 2,2, 1,2,3,4",
+        "        .entry LOOP",
+        "        stop",
+    };
+    size_t n = sizeof(lines) / sizeof(lines[0]);
+    size_t cap = 1u << 20, len = 0;
+    char *buf = malloc(cap);
+    if (!buf) return NULL;
+    for (size_t i = 0; len + 64 < cap; i = (i + 1) % n) {
+        size_t l = strlen(lines[i]);
+        memcpy(buf + len, lines[i], l);
+        len += l;
+        buf[len++] = '\n';
+    }
+    *size = len;
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    SourceBuffer sb;
+    char *text = NULL;
+    size_t size = 0;
+    if (argc > 1) {
+        if (!load_source(argv[1], &sb)) return 1;
+        size = sb.size;
+    } else {
+        text = generate(&size);
+        if (!text || !load_source_memory(text, size, &sb)) return 1;
+    }
+    if (size == 0) { fprintf(stderr, "empty input\n"); return 1; }
+    int rounds = (int)(MIN_BYTES / size) + 1;
+
+    /* the line index */
+    double t0 = now();
+    for (int r = 0; r < rounds; r++) {
+        SourceBuffer idx;
+        if (!load_source_memory(sb.data, size, &idx)) return 1;
+        free_source(&idx);
+    }
+    double index_s = now() - t0;
+
+    /* tokens only */
+    long tokens = 0;
+    t0 = now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < sb.line_count; i++) {
+            Lexer lx;
+            Token tok;
+            lex_init(&lx, sb.lines[i].ptr, sb.lines[i].len);
+            while (lex_next(&lx, &tok)) tokens++;
+        }
+    }
+    double lex_s = now() - t0;
+
+    /* whole statements, as the first pass parses them */
+    Arena arena;
+    arena_init(&arena, 0);
+    ErrorSink quiet;
+    error_sink_init(&quiet);
+    error_bind_sink(&quiet);
+    t0 = now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < sb.line_count; i++) {
+            ParsedLine pl;
+            parse_line(sb.lines[i].ptr, sb.lines[i].len, &pl, i + 1, &arena);
+        }
+        arena_reset(&arena);
+    }
+    double parse_s = now() - t0;
+    error_bind_sink(NULL);
+
+    double mb = (double)size * rounds / 1e6;
+    printf("input:  %zu bytes, %d lines, %d rounds (%s scan kernel)\n",
+           size, sb.line_count, rounds, scan_kernel());
+    printf("index:  %8.1f MB/s\n", mb / index_s);
+    printf("lex:    %8.1f MB/s  (%ld tokens)\n", mb / lex_s, tokens);
+    printf("parse:  %8.1f MB/s\n", mb / parse_s);
+
+    error_sink_free(&quiet);
+    arena_free(&arena);
+    free_source(&sb);
+    free(text);
+    return 0;
+}
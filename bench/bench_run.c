@@ -0,0 +1,195 @@
+/*
+ * End-to-end benchmark: run the assembler over each corpus file a few
+ * times and report the best wall time as lines/s and MB/s, with the peak
+ * RSS of the runs.  The results also go to a JSON file, one object per
+ * corpus, so runs on different commits can be compared; -c does that
+ * against an earlier results file.
+ *
+ *     ./bench_run [-r REPEAT] [-o results.json] [-c baseline.json] [-l LABEL]
+ *                 ASSEMBLER file.as ...
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+typedef struct {
+    const char *path;
+    long        lines;
+    long        bytes;
+    double      best_s;
+    double      median_s;
+    long        peak_rss_kb;
+} Result;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Lines and bytes of `path`; false if it can't be read */
+static bool measure_file(const char *path, long *lines, long *bytes) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return false; }
+    char buf[1 << 16];
+    size_t n;
+    int last = '\n';
+    *lines = *bytes = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; i < n; i++) *lines += buf[i] == '\n';
+        *bytes += (long)n;
+        last = buf[n - 1];
+    }
+    if (last != '\n') (*lines)++;
+    fclose(f);
+    return true;
+}
+
+/* Run `assembler path` once: its wall time and peak RSS, or false if it
+ * could not run or failed */
+static bool run_once(const char *assembler, const char *path, double *secs, long *rss_kb) {
+    double t0 = now();
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return false; }
+    if (pid == 0) {
+        execl(assembler, assembler, path, (char *)NULL);
+        perror(assembler);
+        _exit(127);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) != pid) { perror("wait4"); return false; }
+    *secs = now() - t0;
+    *rss_kb = ru.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s %s failed\n", assembler, path);
+        return false;
+    }
+    return true;
+}
+
+/* `s` as a JSON string */
+static void put_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void write_json(FILE *f, const char *label, const char *assembler, int repeat,
+                       const Result *res, int count) {
+    const char *threads = getenv("ASSEMBLER_THREADS");
+    fputs("{\n  \"label\": ", f);
+    put_json_string(f, label);
+    fputs(",\n  \"assembler\": ", f);
+    put_json_string(f, assembler);
+    fputs(",\n  \"threads\": ", f);
+    if (threads) put_json_string(f, threads);
+    else fputs("null", f);
+    fprintf(f, ",\n  \"repeat\": %d,\n  \"runs\": [\n", repeat);
+    for (int i = 0; i < count; i++) {
+        const Result *r = &res[i];
+        fputs("    {\"corpus\": ", f);
+        put_json_string(f, r->path);
+        fprintf(f, ", \"lines\": %ld, \"bytes\": %ld, "
+                   "\"best_s\": %.6f, \"median_s\": %.6f, \"lines_per_s\": %.0f, "
+                   "\"mb_per_s\": %.2f, \"peak_rss_kb\": %ld}%s\n",
+                r->lines, r->bytes, r->best_s, r->median_s,
+                r->lines / r->best_s, r->bytes / r->best_s / 1e6, r->peak_rss_kb,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/* The lines/s and peak RSS of `corpus` in a file written by write_json() */
+static bool find_baseline(const char *baseline, const char *corpus,
+                          double *lines_per_s, long *rss_kb) {
+    FILE *f = fopen(baseline, "r");
+    if (!f) return false;
+    char line[1024], key[512];
+    snprintf(key, sizeof(key), "{\"corpus\": \"%s\",", corpus);
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, key), *lps, *rss;
+        if (p && (lps = strstr(p, "\"lines_per_s\": ")) && (rss = strstr(p, "\"peak_rss_kb\": ")))
+            found = sscanf(lps + 15, "%lf", lines_per_s) == 1 &&
+                    sscanf(rss + 15, "%ld", rss_kb) == 1;
+    }
+    fclose(f);
+    return found;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r REPEAT] [-o results.json] [-c baseline.json] [-l LABEL]\n"
+                    "       ASSEMBLER file.as ...\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int repeat = 5;
+    const char *out_path = NULL, *baseline = NULL, *label = "";
+    int opt;
+    while ((opt = getopt(argc, argv, "r:o:c:l:")) != -1) {
+        switch (opt) {
+        case 'r': repeat = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        case 'c': baseline = optarg; break;
+        case 'l': label = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (repeat < 1 || argc - optind < 2) { usage(argv[0]); return 1; }
+    const char *assembler = argv[optind++];
+    int count = argc - optind;
+    Result *res = calloc((size_t)count, sizeof(*res));
+    double *times = malloc(sizeof(*times) * (size_t)repeat);
+    if (!res || !times) { perror("malloc"); return 1; }
+
+    printf("%-28s %10s %9s %12s %9s %10s\n",
+           "corpus", "lines", "best s", "lines/s", "MB/s", "peak RSS");
+    for (int i = 0; i < count; i++) {
+        Result *r = &res[i];
+        r->path = argv[optind + i];
+        if (!measure_file(r->path, &r->lines, &r->bytes)) return 1;
+        for (int k = 0; k < repeat; k++) {
+            long rss;
+            if (!run_once(assembler, r->path, &times[k], &rss)) return 1;
+            if (rss > r->peak_rss_kb) r->peak_rss_kb = rss;
+        }
+        qsort(times, (size_t)repeat, sizeof(*times), by_value);
+        r->best_s = times[0];
+        r->median_s = times[repeat / 2];
+        printf("%-28s %10ld %9.3f %12.0f %9.2f %7ld KB\n", r->path, r->lines, r->best_s,
+               r->lines / r->best_s, r->bytes / r->best_s / 1e6, r->peak_rss_kb);
+        double base_lps;
+        long base_rss;
+        if (baseline && find_baseline(baseline, r->path, &base_lps, &base_rss) &&
+            base_lps > 0 && base_rss > 0)
+            printf("%-28s %+9.1f%% lines/s, %+.1f%% peak RSS against %s\n", "",
+                   100.0 * (r->lines / r->best_s / base_lps - 1),
+                   100.0 * ((double)r->peak_rss_kb / base_rss - 1), baseline);
+    }
+
+    if (out_path) {
+        FILE *f = fopen(out_path, "w");
+        if (!f) { perror(out_path); return 1; }
+        write_json(f, label, assembler, repeat, res, count);
+        if (fclose(f) != 0) { perror(out_path); return 1; }
+    }
+    free(times);
+    free(res);
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Deterministic synthetic sources for end-to-end benchmarks.  The same
+ * options always give the same file, and every file assembles cleanly.
+ *
+ *     ./gen_corpus [options] > corpus.as
+ *
+ *     --lines N       source statements, macro definitions included (100000)
+ *     --labels N      distinct code labels (1000)
+ *     --macros N      macro definitions (10)
+ *     --fanout N      invocations of each macro (20)
+ *     --data N        values in each .data list (8)
+ *     --mat RxC       size of each .mat (4x4)
+ *     --extern P      percent of label operands naming an external (10)
+ *     --seed N        random seed (1)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+/* every DATA_EVERY-th statement is a .data, .mat or .string */
+#define DATA_EVERY  16
+/* every ENTRY_EVERY-th code label is also an .entry */
+#define ENTRY_EVERY 10
+#define MACRO_BODY  3
+
+typedef struct {
+    long lines, labels, macros, fanout, data, rows, cols, extern_pct;
+    uint64_t seed;
+} Options;
+
+static uint64_t rng_state;
+
+/* splitmix64: small, fast and the same everywhere */
+static uint64_t next_random(void) {
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static long below(long n) {
+    return n > 0 ? (long)(next_random() % (uint64_t)n) : 0;
+}
+
+static const char *const two_operand[] = { "mov", "cmp", "add", "sub", "lea" };
+static const char *const one_operand[] = { "clr", "not", "inc", "dec", "jmp", "bne",
+                                           "jsr", "red", "prn" };
+#define COUNT(a) ((long)(sizeof(a) / sizeof((a)[0])))
+
+static long n_externs, n_data, n_mats;
+
+/* A random operand: register, immediate, label (perhaps external) or an
+ * element of a matrix */
+static void put_operand(FILE *out, const Options *o, bool immediate_ok) {
+    long kind = below(10);
+    if (kind < 3) {
+        fprintf(out, "r%ld", below(8));
+    } else if (kind < 5 && immediate_ok) {
+        fprintf(out, "#%ld", below(2000) - 1000);
+    } else if (kind < 6 && n_mats > 0) {
+        fprintf(out, "M%ld[r%ld][r%ld]", below(n_mats), below(8), below(8));
+    } else if (below(100) < o->extern_pct) {
+        fprintf(out, "X%ld", below(n_externs));
+    } else if (kind < 8 && n_data > 0) {
+        fprintf(out, "D%ld", below(n_data));
+    } else {
+        fprintf(out, "L%ld", below(o->labels));
+    }
+}
+
+static void put_instruction(FILE *out, const Options *o) {
+    long kind = below(20);
+    if (kind < 12) {
+        fprintf(out, " %s ", two_operand[below(COUNT(two_operand))]);
+        put_operand(out, o, true);
+        fputs(", ", out);
+        put_operand(out, o, false);
+    } else if (kind < 19) {
+        fprintf(out, " %s ", one_operand[below(COUNT(one_operand))]);
+        put_operand(out, o, false);
+    } else {
+        fputs(below(2) ? " rts" : " stop", out);
+    }
+}
+
+static void put_data(FILE *out, const Options *o, long index) {
+    switch (index % 3) {
+    case 0:
+        fprintf(out, "D%ld: .data ", index / 3);
+        for (long i = 0; i < o->data; i++)
+            fprintf(out, i ? ", %ld" : "%ld", below(65536) - 32768);
+        break;
+    case 1:
+        fprintf(out, "M%ld: .mat %ld,%ld", index / 3, o->rows, o->cols);
+        for (long i = 0; i < o->rows * o->cols; i++)
+            fprintf(out, ",%ld", below(200) - 100);
+        break;
+    default:
+        fprintf(out, "S%ld: .string \"corpus string %ld\"", index / 3, index);
+    }
+}
+
+static bool parse_long(const char *s, long *out) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || v < 0) return false;
+    *out = v;
+    return true;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--lines N] [--labels N] [--macros N] [--fanout N]\n"
+                    "       [--data N] [--mat RxC] [--extern PERCENT] [--seed N]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    Options o = { 100000, 1000, 10, 20, 8, 4, 4, 10, 1 };
+    for (int i = 1; i < argc; i++) {
+        long *field = NULL;
+        if (i + 1 >= argc) { usage(argv[0]); return 1; }
+        if (strcmp(argv[i], "--lines") == 0) field = &o.lines;
+        else if (strcmp(argv[i], "--labels") == 0) field = &o.labels;
+        else if (strcmp(argv[i], "--macros") == 0) field = &o.macros;
+        else if (strcmp(argv[i], "--fanout") == 0) field = &o.fanout;
+        else if (strcmp(argv[i], "--data") == 0) field = &o.data;
+        else if (strcmp(argv[i], "--extern") == 0) field = &o.extern_pct;
+        else if (strcmp(argv[i], "--mat") == 0) {
+            if (sscanf(argv[++i], "%ldx%ld", &o.rows, &o.cols) != 2 ||
+                o.rows < 1 || o.cols < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+            continue;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            long seed;
+            if (!parse_long(argv[++i], &seed)) { usage(argv[0]); return 1; }
+            o.seed = (uint64_t)seed;
+            continue;
+        }
+        if (!field || !parse_long(argv[++i], field)) { usage(argv[0]); return 1; }
+    }
+    if (o.labels < 1) o.labels = 1;
+    if (o.data < 1) o.data = 1;
+    if (o.extern_pct > 100) o.extern_pct = 100;
+    rng_state = o.seed;
+
+    /* what the statements are made of, so every name used is defined */
+    long definitions = o.macros * (MACRO_BODY + 2);
+    long invocations = o.macros * o.fanout;
+    long body = o.lines - definitions - 2;
+    n_externs = o.labels / 10 + 1;
+    long n_entries = (o.labels + ENTRY_EVERY - 1) / ENTRY_EVERY;
+    body -= n_externs + n_entries;
+    if (body < o.labels + invocations) body = o.labels + invocations;
+    long n_datas = body / DATA_EVERY;
+    n_data = (n_datas + 2) / 3;
+    n_mats = (n_datas + 1) / 3;
+    long code = body - n_datas;
+    if (code < o.labels + invocations) code = o.labels + invocations;
+
+    FILE *out = stdout;
+    fprintf(out, "; gen_corpus --lines %ld --labels %ld --macros %ld --fanout %ld"
+                 " --data %ld --mat %ldx%ld --extern %ld --seed %llu\n",
+            o.lines, o.labels, o.macros, o.fanout, o.data, o.rows, o.cols,
+            o.extern_pct, (unsigned long long)o.seed);
+    for (long i = 0; i < n_externs; i++)
+        fprintf(out, ".extern X%ld\n", i);
+    for (long m = 0; m < o.macros; m++) {
+        fprintf(out, "MACRO mac%ld a,b\n", m);
+        fputs(" mov %a%, %b%\n add #1, %b%\n cmp %a%, r1\n", out);
+        fputs("ENDM\n", out);
+    }
+
+    /* code statements with the labels, invocations and data spread out
+     * evenly among them */
+    long label = 0, call = 0, data = 0;
+    for (long s = 0; s < code; s++) {
+        if (n_datas > 0 && data < n_datas && s * n_datas / code >= data) {
+            put_data(out, &o, data++);
+            fputc('\n', out);
+        }
+        if (invocations > 0 && s * invocations / code >= call) {
+            fprintf(out, " mac%ld r%ld, ", call % o.macros, below(8));
+            if (below(100) < o.extern_pct) fprintf(out, "X%ld\n", below(n_externs));
+            else fprintf(out, "L%ld\n", below(o.labels));
+            call++;
+            continue;
+        }
+        if (label < o.labels && s * o.labels / code >= label)
+            fprintf(out, "L%ld:", label++);
+        put_instruction(out, &o);
+        fputc('\n', out);
+    }
+    /* whatever the spreading left over */
+    for (; data < n_datas; data++) {
+        put_data(out, &o, data);
+        fputc('\n', out);
+    }
+    for (; label < o.labels; label++)
+        fprintf(out, "L%ld: rts\n", label);
+    for (long i = 0; i < o.labels; i += ENTRY_EVERY)
+        fprintf(out, ".entry L%ld\n", i);
+    fputs(" stop\n", out);
+    return ferror(out) ? 1 : 0;
+}
@@ -0,0 +1,412 @@
+/*
+ * Kernel micro-benchmarks: time single calls of the hot helpers on small
+ * sets of representative inputs and report nanoseconds per call.  Each
+ * kernel is warmed up, its batch size is doubled until one sample takes
+ * at least the minimum sample time, and then REPEAT samples are taken.
+ * The thread is pinned to one CPU so migrations and the frequency of
+ * another core don't leak into the numbers.  The results can be written
+ * to a JSON file and compared with an earlier one, like bench_run's.
+ *
+ *     ./microbench [-r REPEAT] [-t SAMPLE_MS] [-w WARMUP_MS] [-p CPU]
+ *                  [-o results.json] [-c baseline.json] [kernel ...]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "utils.h"
+#include "symbol_table.h"
+#include "instructions.h"
+#include "error.h"
+
+/* every input set has this many entries, so a mask picks the next one */
+#define NINPUTS 16
+#define MASK    (NINPUTS - 1)
+
+/* results go here so the calls can't be optimised away */
+static volatile uint64_t sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ------------------------------------------------------------------ */
+/* inputs */
+
+static const char *const source_lines[NINPUTS] = {
+    "MAIN:   mov r3, LENGTH",
+    "LOOP:   jmp L1",
+    "        prn #-5",
+    "        mov M1[r2][r7], r3     ; copy an element",
+    "        sub r1, r4",
+    "        bne END",
+    "; a comment line",
+    "STR:    .string \"abcdef\"",
+    "LENGTH: .data 6,-9,15",
+    "M1:     .mat 2,2, 1,2,3,4",
+    "        .entry LOOP",
+    "        stop",
+    "        cmp #12, COUNT",
+    "        lea STR, r6",
+    "        inc K",
+    "END:    rts",
+};
+
+static const char *const padded[NINPUTS] = {
+    "  mov r3, LENGTH  ", "\tLOOP", "r1 ", " 6,-9,15\t", "", "   ",
+    "  .entry LOOP", "stop", " prn #-5 ", "\t\tM1[r2][r7]\t\t", " x", "END: rts  ",
+    "  a , b  ", "label", "   counter   ", "\t#1\t",
+};
+
+static const char *const lists[NINPUTS] = {
+    "r3, LENGTH", "6,-9,15", "1,2,3,4", "M1[r2][r7], r3", "#-5", "a, b",
+    "STR, r6", "#12, COUNT", "100, 200, 300, 400, 500", "x", "r1,r2", "-1",
+    "  L1 ,  L2  ", "0,0,0,0,0,0,0,0", "K", "1, 2",
+};
+
+/* a macro body line and one %param% occurrence in it */
+static const char *const templates[NINPUTS][2] = {
+    { " mov %a%, %b%", "%a%" },     { " add #1, %b%", "%b%" },
+    { " cmp %a%, r1", "%a%" },      { " prn %x%", "%x%" },
+    { " jmp %dest%", "%dest%" },    { " mov %a%, %a%", "%a%" },
+    { " lea %s%, r6", "%s%" },      { " stop", "%a%" },
+    { " mov %a%, %b%", "%b%" },     { " inc %cnt%", "%cnt%" },
+    { " sub %a%, %b%", "%a%" },     { " red %r%", "%r%" },
+    { " mov %m%[r1][r2], r3", "%m%" }, { " clr %a%", "%a%" },
+    { " bne %l%", "%l%" },          { " not %reg%", "%reg%" },
+};
+
+static const char *const mnemonics[NINPUTS] = {
+    "mov", "cmp", "add", "sub", "lea", "clr", "not", "inc",
+    "dec", "jmp", "bne", "jsr", "red", "prn", "rts", "stop",
+};
+
+/* what label and operand positions look like: keywords and plain names */
+static const char *const words[NINPUTS] = {
+    "mov", "STOP", "r3", "LOOP", "counter", "prn", "extern", "MAIN",
+    "r7", "x", "data", "LENGTH", "M1", "jsr", "string", "END",
+};
+
+static const char *const instructions[NINPUTS] = {
+    "mov r3, L12", "jmp L40", "prn #-5", "mov M1[r2][r7], r3",
+    "sub r1, r4", "bne X3", "cmp #12, L7", "lea L99, r6",
+    "inc L3", "red r2", "mov L1, L2", "add #100, r0",
+    "jsr X1", "not M1[r0][r1]", "clr L5", "rts",
+};
+
+#define SYMBOLS 5000
+
+static SymbolTable symtab;
+static Arena       symtab_arena;
+/* names looked up: one in eight is missing */
+static char        names[NINPUTS][16];
+static ParsedLine  decoded[NINPUTS];
+static Arena       decoded_arena;
+
+static void setup(void) {
+    arena_init(&symtab_arena, 0);
+    init_symbol_table(&symtab, &symtab_arena);
+    char name[16];
+    for (int i = 0; i < SYMBOLS; i++) {
+        snprintf(name, sizeof(name), "L%d", i);
+        add_symbol(&symtab, name, 100 + i, SYM_CODE);
+    }
+    add_symbol(&symtab, "M1", 90, SYM_DATA);
+    for (int i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "X%d", i);
+        add_symbol(&symtab, name, 0, SYM_EXTERNAL);
+    }
+    for (int i = 0; i < NINPUTS; i++)
+        snprintf(names[i], sizeof(names[i]), i % 8 == 7 ? "Q%d" : "L%d", i * 311 % SYMBOLS);
+
+    arena_init(&decoded_arena, 0);
+    for (int i = 0; i < NINPUTS; i++) {
+        const char *s = instructions[i];
+        if (!parse_line(s, (int)strlen(s), &decoded[i], i + 1, &decoded_arena) ||
+            decoded[i].type != STMT_INSTRUCTION) {
+            fprintf(stderr, "bad benchmark input: %s\n", s);
+            exit(1);
+        }
+        decode_instruction(&decoded[i], &decoded_arena);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* kernels: `calls` calls, cycling through the inputs */
+
+static void bench_parse_line(long calls) {
+    static Arena arena;
+    static bool ready;
+    if (!ready) { arena_init(&arena, 0); ready = true; }
+    ParsedLine pl;
+    for (long i = 0; i < calls; i++) {
+        const char *s = source_lines[i & MASK];
+        sink += parse_line(s, (int)strlen(s), &pl, 1, &arena);
+        if ((i & MASK) == MASK) arena_reset(&arena);
+    }
+}
+
+/* trim_string works in place, so each call trims a fresh copy; the copy is
+ * part of every sample and cancels out in comparisons */
+static void bench_trim_string(long calls) {
+    char buf[64];
+    for (long i = 0; i < calls; i++) {
+        strcpy(buf, padded[i & MASK]);
+        trim_string(buf);
+        sink += (unsigned char)buf[0];
+    }
+}
+
+static void bench_split_string(long calls) {
+    char tokens[8][80];
+    for (long i = 0; i < calls; i++)
+        sink += split_string(lists[i & MASK], ',', tokens, 8);
+}
+
+static void bench_replace_substring(long calls) {
+    for (long i = 0; i < calls; i++) {
+        char *s = replace_substring(templates[i & MASK][0], templates[i & MASK][1], "r3");
+        sink += (unsigned char)s[1];
+        free(s);
+    }
+}
+
+static void bench_find_symbol(long calls) {
+    for (long i = 0; i < calls; i++)
+        sink += find_symbol(&symtab, names[i & MASK]) != NULL;
+}
+
+static void bench_lookup_symbol(long calls) {
+    for (long i = 0; i < calls; i++)
+        sink += lookup_symbol(&symtab, names[i & MASK]) != NULL;
+}
+
+static void bench_opcode_to_num(long calls) {
+    for (long i = 0; i < calls; i++)
+        sink += opcode_to_num(mnemonics[i & MASK]);
+}
+
+static void bench_is_reserved_word(long calls) {
+    for (long i = 0; i < calls; i++)
+        sink += is_reserved_word(words[i & MASK]);
+}
+
+static void bench_encode_instruction(long calls) {
+    static Arena arena;
+    static bool ready;
+    if (!ready) { arena_init(&arena, 0); ready = true; }
+    CPUState cpu = {0};
+    cpu.symtab = &symtab;
+    cpu.arena = &arena;
+    uint16_t out[MAX_INSTRUCTION_WORDS];
+    for (long i = 0; i < calls; i++) {
+        sink += encode_instruction(&decoded[i & MASK], &cpu, out);
+        /* external uses pile up in the arena */
+        if ((i & MASK) == MASK) {
+            cpu.ext_uses = NULL;
+            arena_reset(&arena);
+        }
+    }
+}
+
+static void bench_convert_to_base4(long calls) {
+    char out[16];
+    for (long i = 0; i < calls; i++) {
+        convert_to_base4((uint16_t)(i * 40503u), out);
+        sink += (unsigned char)out[7];
+    }
+}
+
+typedef struct {
+    const char *name;
+    void      (*run)(long calls);
+} Kernel;
+
+static const Kernel kernels[] = {
+    { "parse_line",         bench_parse_line },
+    { "trim_string",        bench_trim_string },
+    { "split_string",       bench_split_string },
+    { "replace_substring",  bench_replace_substring },
+    { "find_symbol",        bench_find_symbol },
+    { "lookup_symbol",      bench_lookup_symbol },
+    { "opcode_to_num",      bench_opcode_to_num },
+    { "is_reserved_word",   bench_is_reserved_word },
+    { "encode_instruction", bench_encode_instruction },
+    { "convert_to_base4",   bench_convert_to_base4 },
+};
+#define NKERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+/* ------------------------------------------------------------------ */
+/* measurement */
+
+typedef struct {
+    const char *name;
+    long        calls;      /* per sample */
+    double      min_ns, median_ns, mean_ns, stddev_ns;
+} Result;
+
+static double time_calls(const Kernel *k, long calls) {
+    double t0 = now();
+    k->run(calls);
+    return now() - t0;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(const Kernel *k, int repeat, double sample_s, double warmup_s,
+                    double *samples, Result *r) {
+    /* warm up caches, branch predictors and the clock speed while finding
+     * a batch that takes at least sample_s */
+    long calls = 1;
+    double start = now();
+    while (time_calls(k, calls) < sample_s && calls < (1L << 40)) calls *= 2;
+    while (now() - start < warmup_s) time_calls(k, calls);
+
+    double sum = 0;
+    for (int s = 0; s < repeat; s++) {
+        samples[s] = time_calls(k, calls) / calls * 1e9;
+        sum += samples[s];
+    }
+    r->name = k->name;
+    r->calls = calls;
+    r->mean_ns = sum / repeat;
+    double var = 0;
+    for (int s = 0; s < repeat; s++)
+        var += (samples[s] - r->mean_ns) * (samples[s] - r->mean_ns);
+    r->stddev_ns = repeat > 1 ? sqrt(var / (repeat - 1)) : 0;
+    qsort(samples, (size_t)repeat, sizeof(*samples), by_value);
+    r->min_ns = samples[0];
+    r->median_ns = samples[repeat / 2];
+}
+
+/* Pin the calling thread to `cpu` (the current one if negative); returns
+ * the CPU, or -1 if pinning is not possible */
+static int pin_thread(int cpu) {
+    if (cpu < 0) cpu = sched_getcpu();
+    if (cpu < 0) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+}
+
+static void write_json(FILE *f, int cpu, int repeat, const Result *res, int count) {
+    fprintf(f, "{\n  \"cpu\": %d,\n  \"repeat\": %d,\n  \"kernels\": [\n", cpu, repeat);
+    for (int i = 0; i < count; i++) {
+        const Result *r = &res[i];
+        fprintf(f, "    {\"kernel\": \"%s\", \"calls\": %ld, \"min_ns\": %.3f, "
+                   "\"median_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f}%s\n",
+                r->name, r->calls, r->min_ns, r->median_ns, r->mean_ns, r->stddev_ns,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/* The median of `kernel` in a file written by write_json() */
+static bool find_baseline(const char *baseline, const char *kernel, double *median_ns) {
+    FILE *f = fopen(baseline, "r");
+    if (!f) return false;
+    char line[512], key[128];
+    snprintf(key, sizeof(key), "{\"kernel\": \"%s\",", kernel);
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, key), *m;
+        if (p && (m = strstr(p, "\"median_ns\": ")))
+            found = sscanf(m + 13, "%lf", median_ns) == 1;
+    }
+    fclose(f);
+    return found;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r REPEAT] [-t SAMPLE_MS] [-w WARMUP_MS] [-p CPU]\n"
+                    "       [-o results.json] [-c baseline.json] [kernel ...]\n", prog);
+    fprintf(stderr, "Kernels:");
+    for (int k = 0; k < NKERNELS; k++) fprintf(stderr, " %s", kernels[k].name);
+    fputc('\n', stderr);
+}
+
+int main(int argc, char **argv) {
+    int repeat = 15, cpu = -1;
+    double sample_ms = 20, warmup_ms = 100;
+    const char *out_path = NULL, *baseline = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:t:w:p:o:c:")) != -1) {
+        switch (opt) {
+        case 'r': repeat = atoi(optarg); break;
+        case 't': sample_ms = atof(optarg); break;
+        case 'w': warmup_ms = atof(optarg); break;
+        case 'p': cpu = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        case 'c': baseline = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (repeat < 1 || sample_ms <= 0 || warmup_ms < 0) { usage(argv[0]); return 1; }
+
+    /* only the kernels named on the command line, if any */
+    bool selected[NKERNELS];
+    for (int k = 0; k < NKERNELS; k++) selected[k] = optind == argc;
+    for (int i = optind; i < argc; i++) {
+        int k = 0;
+        while (k < NKERNELS && strcmp(argv[i], kernels[k].name) != 0) k++;
+        if (k == NKERNELS) { usage(argv[0]); return 1; }
+        selected[k] = true;
+    }
+
+    int pinned = pin_thread(cpu);
+    if (pinned < 0) fprintf(stderr, "warning: could not pin to a CPU; expect more noise\n");
+
+    /* nothing should be reported, but keep it off the terminal if it is */
+    ErrorSink quiet;
+    error_sink_init(&quiet);
+    error_bind_sink(&quiet);
+    setup();
+
+    Result res[NKERNELS];
+    double *samples = malloc(sizeof(*samples) * (size_t)repeat);
+    if (!samples) { perror("malloc"); return 1; }
+    int count = 0;
+
+    printf("pinned to CPU %d, %d samples of at least %.0f ms, %.0f ms warm-up\n",
+           pinned, repeat, sample_ms, warmup_ms);
+    printf("%-20s %12s %10s %10s %10s %8s\n",
+           "kernel", "calls/sample", "min ns", "median ns", "mean ns", "cv");
+    for (int k = 0; k < NKERNELS; k++) {
+        if (!selected[k]) continue;
+        Result *r = &res[count++];
+        measure(&kernels[k], repeat, sample_ms / 1e3, warmup_ms / 1e3, samples, r);
+        printf("%-20s %12ld %10.2f %10.2f %10.2f %7.2f%%\n", r->name, r->calls,
+               r->min_ns, r->median_ns, r->mean_ns,
+               r->mean_ns > 0 ? 100.0 * r->stddev_ns / r->mean_ns : 0.0);
+        double base;
+        if (baseline && find_baseline(baseline, r->name, &base) && base > 0)
+            printf("%-20s %+11.1f%% median against %s\n", "",
+                   100.0 * (r->median_ns / base - 1), baseline);
+    }
+    if (quiet.count > 0)
+        fprintf(stderr, "warning: the kernels reported %d errors\n", quiet.count);
+
+    if (out_path) {
+        FILE *f = fopen(out_path, "w");
+        if (!f) { perror(out_path); return 1; }
+        write_json(f, pinned, repeat, res, count);
+        if (fclose(f) != 0) { perror(out_path); return 1; }
+    }
+    error_bind_sink(NULL);
+    error_sink_free(&quiet);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "sha256.h"
+#include "symbol_table.h"   /* BASE_ADDRESS */
+#include "utils.h"
+#include "error.h"
+
+#define COPY_BLOCK (64 * 1024)
+/* a long-running process (the daemon) evicts after this many stores */
+#define EVICT_EVERY 1024
+
+/* set once by cache_configure, read-only while files are assembled */
+static char     *cache_dir;
+static long long cache_limit;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static long cache_hits, cache_misses, cache_evicted;
+static long stores_since_evict;
+
+/* The output kinds, the .ob last: its presence marks a complete entry */
+static const char *const kinds[] = { ".ent", ".ext", ".ob" };
+#define KIND_COUNT 3
+
+bool cache_configure(const char *dir, long long max_bytes) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        print_system_error(dir);
+        return false;
+    }
+    free(cache_dir);
+    cache_dir = strdup(dir);
+    if (!cache_dir) error_exit("Memory allocation failed");
+    cache_limit = max_bytes;
+    return true;
+}
+
+bool cache_enabled(void) {
+    return cache_dir != NULL;
+}
+
+void cache_key(const char *data, size_t size, char key[CACHE_KEY_LEN + 1]) {
+    static const char hex[] = "0123456789abcdef";
+    char salt[64];
+    int n = snprintf(salt, sizeof(salt), "cassembler %s base %d", ASSEMBLER_VERSION, BASE_ADDRESS);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update(&h, salt, (size_t)n + 1);
+    sha256_update(&h, data, size);
+    sha256_final(&h, digest);
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        key[2*i] = hex[digest[i] >> 4];
+        key[2*i + 1] = hex[digest[i] & 15];
+    }
+    key[CACHE_KEY_LEN] = '\0';
+}
+
+/* Path of one file of a cache entry */
+static char *entry_path(const char *key, const char *kind) {
+    size_t len = strlen(cache_dir) + 1 + CACHE_KEY_LEN + strlen(kind) + 1;
+    char *path = malloc(len);
+    if (!path) error_exit("Memory allocation failed");
+    snprintf(path, len, "%s/%s%s", cache_dir, key, kind);
+    return path;
+}
+
+/* Copy the contents of an open descriptor to another */
+static bool copy_fd(int in, int out) {
+    char *buf = malloc(COPY_BLOCK);
+    if (!buf) return false;
+    bool ok = true;
+    ssize_t n;
+    while (ok && (n = read(in, buf, COPY_BLOCK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) { ok = false; break; }
+            off += w;
+        }
+    }
+    free(buf);
+    return ok;
+}
+
+/* Copy `from` to `to`, replacing it.  Fails quietly if `from` is missing. */
+static bool copy_file(const char *from, const char *to) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) return false;
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0) { close(in); return false; }
+    bool ok = copy_fd(in, out);
+    ok = close(out) == 0 && ok;
+    close(in);
+    return ok;
+}
+
+bool cache_restore(const char *key, const char *base) {
+    bool hit = true;
+    char *marker = entry_path(key, ".ob");
+    if (access(marker, F_OK) != 0) hit = false;
+
+    for (int k = 0; hit && k < KIND_COUNT; k++) {
+        char *from = entry_path(key, kinds[k]);
+        char *to = strcat_printf(base, kinds[k]);
+        if (!to) error_exit("Memory allocation failed");
+        if (!copy_file(from, to)) {
+            if (access(from, F_OK) == 0 || k == KIND_COUNT - 1)
+                hit = false;      /* unreadable, or evicted under us */
+            else
+                remove(to);       /* the program has no such output */
+        }
+        free(from);
+        free(to);
+    }
+    /* mark the entry as recently used */
+    if (hit) utimensat(AT_FDCWD, marker, NULL, 0);
+    free(marker);
+
+    pthread_mutex_lock(&stats_lock);
+    if (hit) cache_hits++;
+    else cache_misses++;
+    pthread_mutex_unlock(&stats_lock);
+    return hit;
+}
+
+static void evict(void);
+
+void cache_store(const char *key, const char *base) {
+    pthread_mutex_lock(&stats_lock);
+    if (++stores_since_evict >= EVICT_EVERY) {
+        stores_since_evict = 0;
+        evict();
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    for (int k = 0; k < KIND_COUNT; k++) {
+        char *from = strcat_printf(base, kinds[k]);
+        if (!from) error_exit("Memory allocation failed");
+        int in = open(from, O_RDONLY);
+        free(from);
+        if (in < 0) continue;
+
+        /* write under a temporary name so readers never see a partial file */
+        char *tmp = entry_path("tmp.XXXXXX", "");
+        int out = mkstemp(tmp);
+        bool ok = out >= 0 && copy_fd(in, out);
+        if (out >= 0) ok = close(out) == 0 && ok;
+        close(in);
+        if (ok) {
+            char *to = entry_path(key, kinds[k]);
+            ok = rename(tmp, to) == 0;
+            free(to);
+        }
+        if (!ok && out >= 0) unlink(tmp);
+        free(tmp);
+        if (!ok) return;   /* no .ob means the entry is never used */
+    }
+}
+
+/* One cache entry, for eviction */
+typedef struct {
+    char      key[CACHE_KEY_LEN + 1];
+    long long bytes;      /* all files of the entry */
+    struct timespec used; /* mtime of the .ob */
+} Entry;
+
+static int by_oldest(const void *a, const void *b) {
+    const Entry *x = a, *y = b;
+    if (x->used.tv_sec != y->used.tv_sec) return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    if (x->used.tv_nsec != y->used.tv_nsec) return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/* Remove least recently used entries until the directory fits the limit.
+ * Called with stats_lock held or after all assemblies are done. */
+static void evict(void) {
+    DIR *d = opendir(cache_dir);
+    if (!d) return;
+    Entry *entries = NULL;
+    int count = 0, cap = 0;
+    long long total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len != CACHE_KEY_LEN + 3 || strcmp(de->d_name + CACHE_KEY_LEN, ".ob") != 0)
+            continue;
+        if (count >= cap) {
+            cap = cap ? cap * 2 : 256;
+            Entry *tmp = realloc(entries, sizeof(*entries) * cap);
+            if (!tmp) break;
+            entries = tmp;
+        }
+        Entry *e = &entries[count];
+        memcpy(e->key, de->d_name, CACHE_KEY_LEN);
+        e->key[CACHE_KEY_LEN] = '\0';
+        e->bytes = 0;
+        e->used.tv_sec = 0;
+        e->used.tv_nsec = 0;
+        for (int k = 0; k < KIND_COUNT; k++) {
+            struct stat st;
+            char *path = entry_path(e->key, kinds[k]);
+            if (stat(path, &st) == 0) {
+                e->bytes += st.st_size;
+                if (k == KIND_COUNT - 1) e->used = st.st_mtim;
+            }
+            free(path);
+        }
+        total += e->bytes;
+        count++;
+    }
+    closedir(d);
+
+    if (total > cache_limit) {
+        qsort(entries, count, sizeof(*entries), by_oldest);
+        for (int i = 0; i < count && total > cache_limit; i++) {
+            /* the .ob goes first so a half-removed entry is never a hit */
+            for (int k = KIND_COUNT - 1; k >= 0; k--) {
+                char *path = entry_path(entries[i].key, kinds[k]);
+                remove(path);
+                free(path);
+            }
+            total -= entries[i].bytes;
+            cache_evicted++;
+        }
+    }
+    free(entries);
+}
+
+void cache_finish(FILE *stats) {
+    if (!cache_dir) return;
+    pthread_mutex_lock(&stats_lock);
+    evict();
+    pthread_mutex_unlock(&stats_lock);
+    if (stats)
+        fprintf(stats, "cache: %ld hits, %ld misses, %ld evicted\n",
+                cache_hits, cache_misses, cache_evicted);
+    free(cache_dir);
+    cache_dir = NULL;
+}
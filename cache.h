@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Part of every cache key: bump it whenever the output for a given source
+ * may change, so entries written by older assemblers are never used */
+#define ASSEMBLER_VERSION "1.1"
+
+/* Hex SHA-256, without the terminating NUL */
+#define CACHE_KEY_LEN 64
+
+/* Default bound on the cache directory when --cache-size is not given */
+#define CACHE_DEFAULT_LIMIT (512LL * 1024 * 1024)
+
+/*
+ * Use `dir` (created if missing) to remember the .ob/.ent/.ext of every
+ * file that assembles without diagnostics.  Once the run is over,
+ * cache_finish() removes the least recently used entries until the
+ * directory holds at most `max_bytes`.  Must be called before any
+ * assembly starts.
+ */
+bool cache_configure(const char *dir, long long max_bytes);
+bool cache_enabled(void);
+
+/* Key of a source: SHA-256 over the assembler version, BASE_ADDRESS and
+ * the source bytes */
+void cache_key(const char *data, size_t size, char key[CACHE_KEY_LEN + 1]);
+
+/* Recreate the outputs `base`.ob/.ent/.ext from the entry for `key`.
+ * Returns false (a miss) if there is no complete entry. */
+bool cache_restore(const char *key, const char *base);
+
+/* Save the outputs of a successful assembly under `key` */
+void cache_store(const char *key, const char *base);
+
+/* Evict down to the size limit; with `stats`, report hits and misses */
+void cache_finish(FILE *stats);
+
+#endif /* CACHE_H */
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "cassembler.h"
+#include "assemble.h"
+#include "source.h"
+#include "utils.h"
+#include "error.h"
+
+struct Assembler {
+    Arena        arena;      /* results of the last assembly */
+    Arena        scratch;    /* macro text, recycled within an assembly */
+    ErrorSink    sink;       /* routes diagnostics to the callback */
+    SourceBuffer src;        /* line index of the source being assembled */
+    bool         src_loaded;
+    AsmDiagnosticFn on_diagnostic;
+    void        *user;
+};
+
+static void forward_diagnostic(void *user, const Diagnostic *d) {
+    Assembler *as = user;
+    if (!as->on_diagnostic) return;
+    AsmDiagnostic diag = {
+        d->severity == DIAG_ERROR ? ASM_ERROR : ASM_SYSTEM,
+        d->line, d->code, d->message
+    };
+    as->on_diagnostic(as->user, &diag);
+}
+
+Assembler *assembler_new(AsmDiagnosticFn on_diagnostic, void *user) {
+    Assembler *as = calloc(1, sizeof(*as));
+    if (!as) return NULL;
+    arena_init(&as->arena, 0);
+    arena_init(&as->scratch, 0);
+    error_sink_init(&as->sink);
+    as->on_diagnostic = on_diagnostic;
+    as->user = user;
+    as->sink.callback = forward_diagnostic;
+    as->sink.user = as;
+    return as;
+}
+
+void assembler_free(Assembler *as) {
+    if (!as) return;
+    arena_free(&as->arena);
+    arena_free(&as->scratch);
+    error_sink_free(&as->sink);
+    free(as);
+}
+
+/* Copy the entry symbols and external uses into flat arrays, in the order
+ * the .ent and .ext files list them */
+static void collect_symbols(Assembler *as, const Assembly *res, AsmResult *out) {
+    const SymbolTable *st = &res->symtab;
+    int n = 0;
+    for (int id = 0; id < symbol_count(st); id++)
+        if (symbol_at(st, id)->type == SYM_ENTRY) n++;
+    AsmSymbol *entries = arena_alloc(&as->arena, sizeof(*entries) * (n ? n : 1));
+    if (!entries) error_exit("Memory allocation failed");
+    n = 0;
+    for (int id = symbol_count(st) - 1; id >= 0; id--) {
+        const Symbol *s = symbol_at(st, id);
+        if (s->type != SYM_ENTRY) continue;
+        entries[n].name = s->name;
+        entries[n].address = s->address;
+        n++;
+    }
+    out->entries = entries;
+    out->entry_count = n;
+
+    n = 0;
+    for (const ExternalUse *u = res->ext_uses; u; u = u->next) n++;
+    AsmSymbol *externals = arena_alloc(&as->arena, sizeof(*externals) * (n ? n : 1));
+    if (!externals) error_exit("Memory allocation failed");
+    n = 0;
+    for (const ExternalUse *u = res->ext_uses; u; u = u->next) {
+        externals[n].name = u->name;
+        externals[n].address = u->address;
+        n++;
+    }
+    out->externals = externals;
+    out->external_count = n;
+}
+
+bool assembler_assemble(Assembler *as, const char *source, size_t len, AsmResult *out) {
+    jmp_buf recover;
+    volatile bool ok = false;
+    ErrorSink *prev = error_bound_sink();
+    Assembly res;
+
+    memset(out, 0, sizeof(*out));
+    out->base_address = BASE_ADDRESS;
+    arena_reset(&as->arena);
+    arena_reset(&as->scratch);
+    as->sink.count = 0;
+    as->sink.recover = &recover;
+    error_bind_sink(&as->sink);
+
+    /* error_exit() inside the passes lands back here instead of exiting */
+    if (setjmp(recover) == 0) {
+        if (!load_source_memory(source, len, &as->src))
+            error_exit("Memory allocation failed");
+        as->src_loaded = true;
+        if (assemble_lines(as->src.lines, as->src.line_count,
+                           &as->arena, &as->scratch, &res) &&
+            get_error_count() == 0) {
+            out->code = res.code;
+            out->code_count = res.code_count;
+            out->data = res.data;
+            out->data_count = res.data_count;
+            collect_symbols(as, &res, out);
+            ok = true;
+        }
+    }
+
+    if (as->src_loaded) {
+        free_source(&as->src);
+        as->src_loaded = false;
+    }
+    as->sink.recover = NULL;
+    error_bind_sink(prev);
+
+    if (!ok) {
+        memset(out, 0, sizeof(*out));
+        out->base_address = BASE_ADDRESS;
+    }
+    out->error_count = as->sink.count;
+    return ok;
+}
@@ -0,0 +1,71 @@
+#ifndef CASSEMBLER_H
+#define CASSEMBLER_H
+
+/*
+ * libcassembler: the assembler as a library.
+ *
+ * Source comes from memory and the results come back as arrays; nothing
+ * touches the filesystem, writes to stderr or calls exit().  Each Assembler
+ * is independent, so different threads may use different Assemblers at the
+ * same time.  A single Assembler must not be shared between threads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    ASM_ERROR,      /* a problem with the source, counted in error_count */
+    ASM_SYSTEM      /* a failed system call, not counted */
+} AsmSeverity;
+
+/* One diagnostic.  The strings are only valid during the callback. */
+typedef struct {
+    AsmSeverity severity;
+    int         line;       /* source line, 0 if not tied to one */
+    const char *code;       /* stable identifier, e.g. "unknown-label" */
+    const char *message;    /* e.g. "Unknown label: LOOP" */
+} AsmDiagnostic;
+
+/* Called once per diagnostic */
+typedef void (*AsmDiagnosticFn)(void *user, const AsmDiagnostic *diag);
+
+typedef struct Assembler Assembler;
+
+/* A symbol name and the absolute address it refers to (or is used at) */
+typedef struct {
+    const char *name;
+    int         address;
+} AsmSymbol;
+
+/* Output of one assembly.  All pointers are owned by the Assembler and stay
+ * valid until its next assembler_assemble() or assembler_free(). */
+typedef struct {
+    int             base_address;    /* address of code[0] */
+    const uint16_t *code;            /* code image */
+    int             code_count;
+    const uint16_t *data;            /* data image, placed right after the code */
+    int             data_count;
+    const AsmSymbol *entries;        /* .entry symbols, in .ent file order */
+    int             entry_count;
+    const AsmSymbol *externals;      /* uses of external symbols, in .ext file order */
+    int             external_count;
+    int             error_count;     /* diagnostics counted as errors */
+} AsmResult;
+
+/* Create an assembler.  `on_diagnostic` may be NULL to drop diagnostics.
+ * Returns NULL if out of memory. */
+Assembler *assembler_new(AsmDiagnosticFn on_diagnostic, void *user);
+
+/* Release the assembler and the results of its last assembly */
+void assembler_free(Assembler *as);
+
+/*
+ * Assemble `len` bytes of source text (it need not be NUL-terminated).
+ * On success fills `out` and returns true.  On failure `out` holds only
+ * the error count and empty arrays.  Running out of memory fails the
+ * assembly with a diagnostic rather than ending the process.
+ */
+bool assembler_assemble(Assembler *as, const char *source, size_t len, AsmResult *out);
+
+#endif /* CASSEMBLER_H */
@@ -15,13 +15,20 @@ void free_data_segment(DataSegment *ds) {
 }
 
 bool append_data_word(DataSegment *ds, uint16_t value) {
-    if (ds->count == ds->capacity) {
+    if (ds->count == ds->capacity && !reserve_data_words(ds, 1))
+        return false;
+    ds->words[ds->count++] = value;
+    return true;
+}
+
+uint16_t *reserve_data_words(DataSegment *ds, int n) {
+    if (n > ds->capacity - ds->count || !ds->words) {
         int newcap = ds->capacity ? ds->capacity * 2 : 64;
-        uint16_t *tmp = realloc(ds->words, newcap * sizeof(uint16_t));
-        if (!tmp) return false;
+        if (newcap - ds->count < n) newcap = ds->count + n;
+        uint16_t *tmp = realloc(ds->words, (size_t)newcap * sizeof(uint16_t));
+        if (!tmp) return NULL;
         ds->words = tmp;
         ds->capacity = newcap;
     }
-    ds->words[ds->count++] = value;
-    return true;
+    return ds->words + ds->count;
 }
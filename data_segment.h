@@ -15,4 +15,8 @@ void init_data_segment(DataSegment *ds);
 void free_data_segment(DataSegment *ds);
 bool append_data_word(DataSegment *ds, uint16_t value);
 
+/* Make room for `n` more words and return where they go, or NULL if out of
+ * memory.  The words are not counted until the caller adds to ds->count. */
+uint16_t *reserve_data_words(DataSegment *ds, int n);
+
 #endif /* DATA_SEGMENT_H */
@@ -2,222 +2,342 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <errno.h>
 
 #include "parser.h"
 #include "symbol_table.h"
 #include "utils.h"
-#include "registers.h"
 #include "error.h"
 #include "data_segment.h"
+#include "stats.h"
+#include "instructions.h"
+#include "lexer.h"
 
-/* Detect matrix operand syntax: <label>[rX][rY]. Returns true if valid. */
-static bool is_matrix_operand(const char *op) {
-    const char *b1 = strchr(op, '[');
-    if (!b1) return false;
-    const char *b2 = strchr(b1 + 1, ']');
-    const char *b3 = b2 ? strchr(b2 + 1, '[') : NULL;
-    const char *b4 = b3 ? strchr(b3 + 1, ']') : NULL;
-    if (!b2 || !b3 || !b4 || b3 != b2 + 1 || *(b4 + 1) != '\0' || b1 == op) {
-        print_error("Invalid matrix operand");
-        return false;
-    }
-    char r1[8], r2[8];
-    strncpy(r1, b1 + 1, b2 - b1 - 1); r1[b2 - b1 - 1] = '\0';
-    strncpy(r2, b3 + 1, b4 - b3 - 1); r2[b4 - b3 - 1] = '\0';
-    if (!is_register(r1) || !is_register(r2)) {
-        print_error("Invalid matrix register");
+/*
+ * Next item of a comma-separated list at *cursor: its bytes without the
+ * surrounding blanks in [*item, *item + *len).  Nothing between two commas
+ * is no item at all; blanks alone are an empty one.  False at the end.
+ */
+static bool next_item(const char **cursor, const char **item, int *len) {
+    const char *p = *cursor;
+    while (*p == ',') p++;
+    if (*p == '\0') {
+        *cursor = p;
         return false;
     }
+    const char *end = strchr(p, ',');
+    if (!end) end = p + strlen(p);
+    *cursor = end;
+    while (p < end && is_space_char(*p)) p++;
+    while (end > p && is_space_char(end[-1])) end--;
+    *item = p;
+    *len = (int)(end - p);
     return true;
 }
 
-/* Estimate number of machine words for an instruction */
-static int count_instruction_words(const ParsedLine *pl) {
-    int words = 1; /* base word */
-    /* Instructions without operands (RTS/STOP) occupy just one word */
-    if (strcasecmp(pl->opcode, "RTS") == 0 ||
-        strcasecmp(pl->opcode, "STOP") == 0)
-        return words;
-
-    if (pl->operands_raw[0] == '\0')
-        return words;
-
-    char ops[2][80];
-    int n = split_string(pl->operands_raw, ',', ops, 2);
-    bool reg_op[2] = {false, false};
-    bool mat_op[2] = {false, false};
-    for (int i = 0; i < n; i++) {
-        mat_op[i] = is_matrix_operand(ops[i]);
-        if (!mat_op[i])
-            reg_op[i] = is_register(ops[i]);
+/* Value of a list item: a decimal number in -32768..32767 with an optional
+ * sign.  Anything else is reported and counts as 0. */
+static int item_value(const char *s, int len) {
+    int i = 0;
+    bool neg = false;
+    if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+        neg = s[0] == '-';
+        i = 1;
+    }
+    int digits = i;
+    int val = 0;
+    for (; i < len && (unsigned)(s[i] - '0') < 10; i++) {
+        if (val <= 32768) val = val * 10 + (s[i] - '0');
+    }
+    if (i == digits || i < len || val > (neg ? 32768 : 32767)) {
+        print_error("Invalid number: %.*s", len, s);
+        return 0;
     }
+    return neg ? -val : val;
+}
 
-    if (n == 1) {
-        if (mat_op[0]) words += 2;
-        else words += reg_op[0] ? 0 : 1;
-    } else if (n == 2) {
-        if (reg_op[0] && reg_op[1]) {
-            words += 1; /* two registers share a word */
-        } else {
-            for (int i = 0; i < 2; i++) {
-                if (mat_op[i]) words += 2;
-                else if (!reg_op[i]) words++;
-            }
-        }
+/* Whether the statement's label names a data address */
+static bool is_data_statement(const ParsedLine *pl) {
+    return pl->type == STMT_DIRECTIVE &&
+           (pl->dir_type == DIR_DATA ||
+            pl->dir_type == DIR_STRING ||
+            pl->dir_type == DIR_MAT);
+}
+
+/* Whether the statement adds to the symbol table */
+static bool defines_symbol(const ParsedLine *pl) {
+    return (pl->has_label && pl->type != STMT_LABEL_ONLY) ||
+           (pl->type == STMT_DIRECTIVE && pl->dir_type == DIR_EXTERN);
+}
+
+/* The symbol-table part of a statement: its label at IC or DC, and the
+ * name of an .extern */
+static void add_statement_symbols(const ParsedLine *pl, SymbolTable *symtab, int IC, int DC) {
+    if (pl->has_label && pl->type != STMT_LABEL_ONLY) {
+        bool is_data = is_data_statement(pl);
+        add_label(symtab, pl->label, is_data ? DC : IC, is_data);
     }
-    return words;
+    if (pl->type == STMT_DIRECTIVE && pl->dir_type == DIR_EXTERN)
+        add_label_external(symtab, pl->directive_args);
 }
 
-/* First pass: build symbol table, count IC/DC */
-bool first_pass(FILE *src, SymbolTable *symtab, int *IC_out, int *DC_out, DataSegment *data_seg) {
-    char *line = NULL;
-    size_t linecap = 0;
-    int IC = 0, DC = 0, ln = 0;
-
-    while (getline(&line, &linecap, src) != -1) {
-        ++ln;
-        ParsedLine pl;
-        if (!parse_line(line, &pl, ln)) {
-            free(pl.directive_args);
-            free(pl.operands_raw);
-            free(line);
-            line = NULL;
-            continue; /* error already logged */
-        }
+/* Everything else: IC/DC, data words and the decoded form of an
+ * instruction.  None of it depends on other statements. */
+static void count_statement(ParsedLine *pl, Arena *arena, int *IC_io, int *DC_io,
+                            DataSegment *data_seg) {
+    int IC = *IC_io, DC = *DC_io;
 
-        /* label addition */
-        if (pl.has_label && pl.type != STMT_LABEL_ONLY) {
-            bool is_data = (pl.type == STMT_DIRECTIVE &&
-                           (pl.dir_type == DIR_DATA ||
-                            pl.dir_type == DIR_STRING ||
-                            pl.dir_type == DIR_MAT));
-            add_label(symtab, pl.label, is_data ? DC : IC, is_data);
+    /* handle directives */
+    if (pl->type == STMT_DIRECTIVE) {
+        switch (pl->dir_type) {
+        case DIR_DATA: {
+            const char *list = pl->directive_args, *item;
+            int len;
+            /* k items take at least 2k - 1 bytes */
+            uint16_t *out = reserve_data_words(data_seg, ((int)strlen(list) + 1) / 2);
+            if (!out) error_exit("Memory allocation failed");
+            int n = 0;
+            while (next_item(&list, &item, &len))
+                out[n++] = (uint16_t)item_value(item, len);
+            data_seg->count += n;
+            DC += n;
+            break;
         }
-
-        /* handle directives */
-        if (pl.type == STMT_DIRECTIVE) {
-            switch (pl.dir_type) {
-            case DIR_DATA: {
-                char tokens[64][80];
-                int n = split_string(pl.directive_args, ',', tokens, 64);
-                for (int i = 0; i < n; i++) {
-                    errno = 0;
-                    char *endptr;
-                    long val = strtol(tokens[i], &endptr, 10);
-                    if (errno != 0 || *endptr != '\0' || endptr == tokens[i] ||
-                        val < -32768 || val > 32767) {
-                        print_error("Invalid number: %s", tokens[i]);
-                        val = 0;
-                    }
-                    append_data_word(data_seg, (uint16_t)val);
-                }
-                DC += n;
+        case DIR_STRING: {
+            char *start = strchr(pl->directive_args, '"');
+            if (!start) {
+                print_error("Missing opening quote");
                 break;
             }
-            case DIR_STRING: {
-                char *start = strchr(pl.directive_args, '"');
-                if (!start) {
-                    print_error("Missing opening quote");
-                    break;
-                }
-                char *end = strrchr(pl.directive_args, '"');
-                if (!end || end == start) {
-                    print_error("Missing closing quote");
-                    break;
-                }
-                for (char *p = start + 1; p < end; ++p) {
-                    append_data_word(data_seg, (uint16_t)(unsigned char)(*p));
-                }
-                append_data_word(data_seg, 0); /* null terminator */
-                DC += (int)(end - start - 1) + 1;
+            char *end = strrchr(pl->directive_args, '"');
+            if (!end || end == start) {
+                print_error("Missing closing quote");
                 break;
             }
-            case DIR_MAT: {
-                char tokens[256][80];
-                int n = split_string(pl.directive_args, ',', tokens, 256);
-                if (n < 2) {
-                    print_error("Invalid .mat directive");
-                    break;
-                }
-
-                errno = 0;
-                char *endptr;
-                long rows = strtol(tokens[0], &endptr, 10);
-                if (errno != 0 || *endptr != '\0' || endptr == tokens[0] ||
-                    rows < -32768 || rows > 32767) {
-                    print_error("Invalid number: %s", tokens[0]);
-                    rows = 0;
-                }
-
-                errno = 0;
-                endptr = NULL;
-                long cols = strtol(tokens[1], &endptr, 10);
-                if (errno != 0 || *endptr != '\0' || endptr == tokens[1] ||
-                    cols < -32768 || cols > 32767) {
-                    print_error("Invalid number: %s", tokens[1]);
-                    cols = 0;
-                }
-
-                int expected = (int)(rows * cols);
-                for (int i = 0; i < expected; i++) {
-                    long val = 0;
-                    if (i + 2 < n) {
-                        errno = 0;
-                        endptr = NULL;
-                        val = strtol(tokens[i + 2], &endptr, 10);
-                        if (errno != 0 || *endptr != '\0' || endptr == tokens[i + 2] ||
-                            val < -32768 || val > 32767) {
-                            print_error("Invalid number: %s", tokens[i + 2]);
-                            val = 0;
-                        }
-                    }
-                    append_data_word(data_seg, (uint16_t)val);
-                }
-                DC += expected;
-                break;
+            for (char *p = start + 1; p < end; ++p) {
+                append_data_word(data_seg, (uint16_t)(unsigned char)(*p));
             }
-            case DIR_EXTERN:
-                add_label_external(symtab, pl.directive_args);
-                break;
-            case DIR_ENTRY:
-                /* entry resolved in second pass */
+            append_data_word(data_seg, 0); /* null terminator */
+            DC += (int)(end - start - 1) + 1;
+            break;
+        }
+        case DIR_MAT: {
+            const char *list = pl->directive_args, *dims[2];
+            int dims_len[2];
+            if (!next_item(&list, &dims[0], &dims_len[0]) ||
+                !next_item(&list, &dims[1], &dims_len[1])) {
+                print_error("Invalid .mat directive");
                 break;
-            default:
-                print_error("Unsupported directive");
             }
-            free(pl.directive_args);
-            free(pl.operands_raw);
-            free(line);
-            line = NULL;
-            continue;
-        }
+            int rows = item_value(dims[0], dims_len[0]);
+            int cols = item_value(dims[1], dims_len[1]);
 
-        /* handle instructions */
-        if (pl.type == STMT_INSTRUCTION) {
-            IC += count_instruction_words(&pl);
-            free(pl.directive_args);
-            free(pl.operands_raw);
-            free(line);
-            line = NULL;
-            continue;
+            /* missing values are zero, extra ones are ignored */
+            int expected = rows * cols;
+            if (expected > 0) {
+                uint16_t *out = reserve_data_words(data_seg, expected);
+                if (!out) error_exit("Memory allocation failed");
+                const char *item;
+                int len;
+                for (int i = 0; i < expected; i++)
+                    out[i] = next_item(&list, &item, &len) ?
+                             (uint16_t)item_value(item, len) : 0;
+                data_seg->count += expected;
+            }
+            DC += expected;
+            break;
         }
-
-        /* label-only or empty/comment: do nothing */
-        free(pl.directive_args);
-        free(pl.operands_raw);
-        free(line);
-        line = NULL;
+        case DIR_EXTERN:
+            /* the name goes into the symbol table */
+            break;
+        case DIR_ENTRY:
+            /* entry resolved in second pass */
+            break;
+        default:
+            print_error("Unsupported directive");
+        }
+    } else if (pl->type == STMT_INSTRUCTION) {
+        /* handle instructions: decode once, the second pass only
+         * fills in label addresses */
+        decode_instruction(pl, arena);
+        IC += pl->ins.size;
     }
+    /* label-only or empty/comment: do nothing */
 
-    free(line);
+    *IC_io = IC;
+    *DC_io = DC;
+}
+
+/* First-pass work for one parsed statement: label, IC/DC, data words and
+ * the decoded form of an instruction */
+void first_pass_statement(ParsedLine *pl, Arena *arena, SymbolTable *symtab,
+                          int *IC_io, int *DC_io, DataSegment *data_seg) {
+    add_statement_symbols(pl, symtab, *IC_io, *DC_io);
+    count_statement(pl, arena, IC_io, DC_io, data_seg);
+}
 
+/* Place data after code and apply the base address to every symbol */
+void first_pass_finish(SymbolTable *symtab, int IC) {
     /* relocate all data symbols by IC */
     relocate_data_symbols(symtab, IC);
 
     /* apply base address to all symbols */
     relocate_all_symbols(symtab, BASE_ADDRESS);
+}
+
+/* A statement that adds to the symbol table, with the chunk-relative
+ * IC and DC it was met at */
+typedef struct {
+    int line;
+    int IC, DC;
+} SymbolEvent;
+
+/* One parser's share: lines[first, last) parsed into parsed[], counted
+ * from IC = DC = 0, with its own data words, strings and diagnostics */
+typedef struct {
+    const LineView *lines;
+    ParsedLine     *parsed;
+    int             first, last;
+    int             IC, DC;
+    DataSegment     data;
+    SymbolEvent    *events;
+    int             event_count, event_cap;
+    Arena           arena;
+    ErrorSink       sink;
+} Parser;
+
+static void add_event(Parser *p, int line) {
+    if (p->event_count == p->event_cap) {
+        int cap = p->event_cap ? p->event_cap * 2 : 256;
+        SymbolEvent *tmp = realloc(p->events, sizeof(*tmp) * cap);
+        if (!tmp) error_exit("Memory allocation failed");
+        p->events = tmp;
+        p->event_cap = cap;
+    }
+    p->events[p->event_count++] = (SymbolEvent){ line, p->IC, p->DC };
+}
+
+/* Parse the lines of parsers[t] (a run_split piece) */
+static void parser_main(void *parsers, int t) {
+    Parser *p = (Parser *)parsers + t;
+    ErrorSink *outer = error_bound_sink();
+    jmp_buf recover;
+    p->sink.recover = &recover;
+    error_bind_sink(&p->sink);
+    /* running out of memory is reported to p->sink, which sends the file
+     * down the serial path */
+    if (setjmp(recover) == 0) {
+        for (int ln = p->first; ln < p->last; ln++) {
+            ParsedLine *pl = &p->parsed[ln];
+            p->sink.line = p->lines[ln].line_no;
+            if (!parse_line_view(&p->lines[ln], pl, &p->arena)) {
+                pl->type = STMT_EMPTY;
+                continue;
+            }
+            if (defines_symbol(pl)) add_event(p, ln);
+            count_statement(pl, &p->arena, &p->IC, &p->DC, &p->data);
+        }
+    }
+    error_bind_sink(outer);
+}
+
+/*
+ * Parse a large file on several threads.  Apart from the symbol table, a
+ * statement needs nothing from the ones before it, so each parser counts
+ * its lines from address 0 and notes where labels and .extern names go.
+ * The symbols are then added in source order, rebased on the IC and DC of
+ * the lines before the chunk, so duplicates are reported as the serial
+ * loop reports them.  If a parser reports anything this gives up
+ * (returning false) before touching symtab or data_seg, and the serial
+ * loop parses the file again.
+ */
+static bool first_pass_parallel(const LineView *lines, int line_count, ParsedLine *parsed,
+                                Arena *arena, SymbolTable *symtab, int *IC_io, int *DC_io,
+                                DataSegment *data_seg) {
+    int npar = split_count(line_count, PARALLEL_MIN_LINES, MAX_SPLIT);
+    if (npar < 2) return false;
+
+    Parser par[MAX_SPLIT];
+    for (int t = 0; t < npar; t++) {
+        Parser *p = &par[t];
+        memset(p, 0, sizeof(*p));
+        p->lines = lines;
+        p->parsed = parsed;
+        p->first = (int)((long long)line_count * t / npar);
+        p->last = (int)((long long)line_count * (t + 1) / npar);
+        init_data_segment(&p->data);
+        arena_init(&p->arena, 0);
+        error_sink_init(&p->sink);
+    }
+    run_split(npar, parser_main, par);
+
+    bool ok = true;
+    for (int t = 0; t < npar; t++)
+        ok = ok && par[t].sink.count == 0;
+    if (ok) {
+        ErrorSink *diag = error_bound_sink();
+        int IC = *IC_io, DC = *DC_io;
+        for (int t = 0; t < npar; t++) {
+            Parser *p = &par[t];
+            for (int i = 0; i < p->event_count; i++) {
+                const SymbolEvent *ev = &p->events[i];
+                error_sink_at(diag, parsed[ev->line].line_number);
+                add_statement_symbols(&parsed[ev->line], symtab, IC + ev->IC, DC + ev->DC);
+            }
+            if (p->data.count > 0) {
+                uint16_t *out = reserve_data_words(data_seg, p->data.count);
+                if (!out) error_exit("Memory allocation failed");
+                memcpy(out, p->data.words, sizeof(uint16_t) * p->data.count);
+                data_seg->count += p->data.count;
+            }
+            IC += p->IC;
+            DC += p->DC;
+            /* parsed[] points into the parser's arena */
+            arena_adopt(arena, &p->arena);
+        }
+        *IC_io = IC;
+        *DC_io = DC;
+    }
+    for (int t = 0; t < npar; t++) {
+        free(par[t].events);
+        free_data_segment(&par[t].data);
+        arena_free(&par[t].arena);
+        error_sink_free(&par[t].sink);
+    }
+    return ok;
+}
+
+/*
+ * First pass: parse every line into parsed[i] (the array shared with the
+ * second pass), build the symbol table and count IC/DC.  Lines that fail to
+ * parse are left as STMT_EMPTY so the second pass skips them.  Operand and
+ * directive strings are allocated from `arena`.
+ */
+bool first_pass(const LineView *lines, int line_count, ParsedLine *parsed, Arena *arena,
+                SymbolTable *symtab, int *IC_out, int *DC_out, DataSegment *data_seg) {
+    int IC = 0, DC = 0;
+    StatMark mark;
+
+    stats_begin(&mark, arena->allocated);
+    if (!first_pass_parallel(lines, line_count, parsed, arena, symtab, &IC, &DC, data_seg)) {
+        ErrorSink *diag = error_bound_sink();
+        for (int ln = 0; ln < line_count; ln++) {
+            ParsedLine *pl = &parsed[ln];
+            /* the rest of the file would only add to the errors */
+            if (error_sink_full(diag)) {
+                for (; ln < line_count; ln++) parsed[ln].type = STMT_EMPTY;
+                break;
+            }
+            error_sink_at(diag, lines[ln].line_no);
+            if (!parse_line_view(&lines[ln], pl, arena)) {
+                pl->type = STMT_EMPTY;
+                continue; /* error already logged */
+            }
+            first_pass_statement(pl, arena, symtab, &IC, &DC, data_seg);
+        }
+    }
+    stats_end(&mark, PHASE_PARSE, arena->allocated);
+
+    first_pass_finish(symtab, IC);
 
     if (IC_out) *IC_out = IC;
     if (DC_out) *DC_out = DC;
@@ -1,197 +1,188 @@
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
 #include <errno.h>
 
 #include "instructions.h"
+#include "keywords.h"
+#include "lexer.h"
 
-/* Opcodes enumeration for encoding
- * MOV=0  CMP=1  ADD=2  SUB=3  LEA=4
- * CLR=5  NOT=6  INC=7  DEC=8
- * JMP=9  BNE=10 JSR=11 RED=12 PRN=13
- * RTS=14 STOP=15
- */
-static int opcode_to_num(const char *opc) {
-    if      (strcasecmp(opc, "MOV") == 0) return 0;
-    else if (strcasecmp(opc, "CMP") == 0) return 1;
-    else if (strcasecmp(opc, "ADD") == 0) return 2;
-    else if (strcasecmp(opc, "SUB") == 0) return 3;
-    else if (strcasecmp(opc, "LEA") == 0) return 4;
-    else if (strcasecmp(opc, "CLR") == 0) return 5;
-    else if (strcasecmp(opc, "NOT") == 0) return 6;
-    else if (strcasecmp(opc, "INC") == 0) return 7;
-    else if (strcasecmp(opc, "DEC") == 0) return 8;
-    else if (strcasecmp(opc, "JMP") == 0) return 9;
-    else if (strcasecmp(opc, "BNE") == 0) return 10;
-    else if (strcasecmp(opc, "JSR") == 0) return 11;
-    else if (strcasecmp(opc, "RED") == 0) return 12;
-    else if (strcasecmp(opc, "PRN") == 0) return 13;
-    else if (strcasecmp(opc, "RTS")  == 0) return 14;
-    else if (strcasecmp(opc, "STOP") == 0) return 15;
-    return -1;
+int opcode_to_num(const char *opc) {
+    Keyword kw = keyword_lookup_str(opc);
+    return kw.kind == KW_OPCODE ? kw.value : -1;
 }
 
-enum { AM_IMMEDIATE = 0, AM_DIRECT = 1, AM_REGISTER = 2, AM_MATRIX = 3 };
-
-/* Parse one operand and return addressing mode bits and optional extra word */
-static int parse_operand(const char *op,
-                         CPUState *cpu,
-                         int *mode_out,
-                         int *reg_out,
-                         uint16_t *extra_out,
-                         Symbol **sym_out) {
-    if (sym_out) *sym_out = NULL;
-    if (!op || op[0] == '\0') {
-        *mode_out = 0; *reg_out = 0; *extra_out = 0; return 0;
+/* Words an operand adds after the first word of its instruction */
+static int operand_words(const Operand *op) {
+    switch (op->mode) {
+    case AM_IMMEDIATE:
+    case AM_DIRECT:  return 1;
+    case AM_MATRIX:  return 2;
+    default:         return 0;
     }
-    if (op[0] == '#') {
-        *mode_out = AM_IMMEDIATE;
-        *reg_out = 0;
+}
+
+/*
+ * Decode one operand from `len` bytes at `s` (already trimmed):
+ * "#n" immediate, "rN" register, "label[rX][rY]" matrix or a label.
+ */
+static void decode_operand(const char *s, int len, Operand *op, Arena *arena) {
+    memset(op, 0, sizeof(*op));
+    op->mode = AM_NONE;
+    if (len == 0) return;
 
+    char *text = arena_strndup(arena, s, (size_t)len);
+    if (!text) error_exit("Memory allocation failed");
+
+    if (text[0] == '#') {
+        op->mode = AM_IMMEDIATE;
         errno = 0;
         char *endptr;
-        long val = strtol(op + 1, &endptr, 10);
-        if (errno != 0 || *endptr != '\0' || endptr == op + 1 ||
+        long val = strtol(text + 1, &endptr, 10);
+        if (errno != 0 || *endptr != '\0' || endptr == text + 1 ||
             val < -32768 || val > 32767) {
-            print_error("Invalid number: %s", op + 1);
-            *extra_out = 0;
+            print_error("Invalid number: %s", text + 1);
         } else {
-            *extra_out = (uint16_t)val;
+            op->value = (int16_t)val;
         }
-        return 1; /* needs extra word */
+        return;
     }
-    if (is_register(op)) {
-        *mode_out = AM_REGISTER;
-        *reg_out = reg_number(op);
-        *extra_out = 0;
-        return 0;
+
+    Keyword kw = keyword_lookup(text, (size_t)len);
+    if (kw.kind == KW_REGISTER) {
+        op->mode = AM_REGISTER;
+        op->reg = (unsigned char)kw.value;
+        return;
     }
 
     /* matrix addressing: <label>[rX][rY] */
-    const char *b1 = strchr(op, '[');
+    char *b1 = strchr(text, '[');
     if (b1) {
         const char *b2 = strchr(b1 + 1, ']');
         const char *b3 = b2 ? strchr(b2 + 1, '[') : NULL;
         const char *b4 = b3 ? strchr(b3 + 1, ']') : NULL;
-        if (!b2 || !b3 || !b4 || b3 != b2 + 1 || *(b4 + 1) != '\0' || b1 == op) {
-            print_error("Invalid matrix operand: %s", op);
-            *mode_out = AM_MATRIX;
-            *reg_out = 0;
-            *extra_out = 0;
-            return 0;
-        }
-        char label[64];
-        strncpy(label, op, b1 - op);
-        label[b1 - op] = '\0';
-        char r1[8];
-        char r2[8];
-        strncpy(r1, b1 + 1, b2 - b1 - 1);
-        r1[b2 - b1 - 1] = '\0';
-        strncpy(r2, b3 + 1, b4 - b3 - 1);
-        r2[b4 - b3 - 1] = '\0';
-        if (!is_register(r1) || !is_register(r2)) {
-            print_error("Invalid register in matrix operand");
-            *mode_out = AM_MATRIX;
-            *reg_out = 0;
-            *extra_out = 0;
-            return 0;
+        op->mode = AM_MATRIX;
+        if (!b2 || !b3 || !b4 || b3 != b2 + 1 || *(b4 + 1) != '\0' || b1 == text) {
+            print_error("Invalid matrix operand");
+            return;
         }
-        int reg1 = reg_number(r1);
-        int reg2 = reg_number(r2);
-        *mode_out = AM_MATRIX;
-        *reg_out = reg1;
-        *extra_out = (uint16_t)((reg1 << 3) | reg2);
-        Symbol *sym = lookup_symbol(cpu->symtab, label);
-        if (sym_out) *sym_out = sym;
-        if (!sym) {
-            print_error("Unknown label: %s", label);
+        Keyword r1 = keyword_lookup(b1 + 1, (size_t)(b2 - b1 - 1));
+        Keyword r2 = keyword_lookup(b3 + 1, (size_t)(b4 - b3 - 1));
+        if (r1.kind != KW_REGISTER || r2.kind != KW_REGISTER) {
+            print_error("Invalid matrix register");
+            return;
         }
-        return 2; /* label address + registers word */
+        op->reg = (unsigned char)r1.value;
+        op->reg2 = (unsigned char)r2.value;
+        *b1 = '\0';
+        op->label = text;
+        return;
     }
 
-    /* direct label */
-    *mode_out = AM_DIRECT;
-    *reg_out = 0;
-    Symbol *sym = lookup_symbol(cpu->symtab, op);
-    if (sym_out) *sym_out = sym;
-    if (!sym) {
-        print_error("Unknown label: %s", op);
-        *extra_out = 0;
-    } else {
-        *extra_out = sym->address;
-    }
-    return 1;
+    op->mode = AM_DIRECT;
+    op->label = text;
 }
 
-/* Encode an instruction into up to 3 words */
-int encode_instruction(const ParsedLine *pl, CPUState *cpu, uint16_t out_words[3]) {
-    uint16_t word0 = 0;
-    int count = 1;
+/* Offsets of the first and one past the last non-blank byte in s[from, to) */
+static void trim_span(const char *s, int *from, int *to) {
+    *from = lex_skip_space(s, *from, *to);
+    while (*to > *from && is_space_char(s[*to - 1])) (*to)--;
+}
 
-    int opc = opcode_to_num(pl->opcode);
-    if (opc < 0) {
-        print_error("Unrecognized opcode");
-        return 0;
+/* Append the mode and extra words of `op` (source when `shift` is 6,
+ * destination when 0) to the instruction */
+static void place_operand(Instruction *ins, Operand *op, int shift) {
+    int mode = op->mode == AM_NONE ? 0 : op->mode;
+    ins->words[0] |= (uint16_t)(((mode & 0x7) << 3 | (op->reg & 0x7)) << shift);
+    switch (op->mode) {
+    case AM_IMMEDIATE:
+        ins->words[ins->count++] = (uint16_t)op->value;
+        break;
+    case AM_DIRECT:
+        op->at = ins->count;
+        ins->words[ins->count++] = 0;
+        break;
+    case AM_MATRIX:
+        op->at = op->label ? ins->count : 0;
+        ins->words[ins->count++] = 0;
+        ins->words[ins->count++] = (uint16_t)((op->reg & 0x7) << 3 | (op->reg2 & 0x7));
+        break;
+    default:
+        break;
     }
-    word0 |= (uint16_t)(opc & 0xF) << 12;
+}
 
-    char src[64] = {0};
-    char dst[64] = {0};
-    bool has_src = false, has_dst = false;
+/*
+ * Two-operand instructions take "src, dst", split at the first comma; a
+ * one-operand instruction takes all of its operand text as the
+ * destination.  RTS and STOP ignore their operands.
+ *
+ * ins.size keeps the layout older assemblers gave instructions with two
+ * register operands: two words, although the registers share the first
+ * word and only one is emitted.  Code addresses depend on it, so the
+ * second pass pads the code image to the counted IC.
+ */
+void decode_instruction(ParsedLine *pl, Arena *arena) {
+    Instruction *ins = &pl->ins;
+    memset(ins, 0, sizeof(*ins));
+    ins->src.mode = ins->dst.mode = AM_NONE;
+    ins->opcode = (signed char)opcode_to_num(pl->opcode);
+    ins->count = 1;
 
-    /* determine operand forms */
-    if (opc <= 4) { /* two-operand instructions */
-        sscanf(pl->operands_raw, "%63[^,],%63s", src, dst);
-        has_src = has_dst = true;
-    } else if (opc == 14 || opc == 15) {
+    const char *ops = pl->operands_raw;
+    int len = (int)strlen(ops);
+    if (ins->opcode == 14 || ins->opcode == 15) {
         /* RTS and STOP have no operands */
-    } else { /* single operand */
-        sscanf(pl->operands_raw, "%63s", dst);
-        has_dst = true;
-    }
-
-    if (has_src) {
-        int mode, reg; uint16_t extra; Symbol *sym = NULL;
-        int needs = parse_operand(src, cpu, &mode, &reg, &extra, &sym);
-        word0 |= (uint16_t)(mode & 0x7) << 9;
-        word0 |= (uint16_t)(reg  & 0x7) << 6;
-        if (needs) {
-            if (mode == AM_MATRIX) {
-                if (sym && sym->type == SYM_EXTERNAL)
-                    add_external_use(&cpu->ext_uses, sym->name,
-                                     cpu->PC + count + BASE_ADDRESS);
-                out_words[count++] = sym ? sym->address : 0;
-                out_words[count++] = extra;
-            } else {
-                if (sym && sym->type == SYM_EXTERNAL)
-                    add_external_use(&cpu->ext_uses, sym->name,
-                                     cpu->PC + count + BASE_ADDRESS);
-                out_words[count++] = extra;
-            }
-        }
-    }
-    if (has_dst) {
-        int mode, reg; uint16_t extra; Symbol *sym = NULL;
-        int needs = parse_operand(dst, cpu, &mode, &reg, &extra, &sym);
-        word0 |= (uint16_t)(mode & 0x7) << 3;
-        word0 |= (uint16_t)(reg  & 0x7);
-        if (needs) {
-            if (mode == AM_MATRIX) {
-                if (sym && sym->type == SYM_EXTERNAL)
-                    add_external_use(&cpu->ext_uses, sym->name,
-                                     cpu->PC + count + BASE_ADDRESS);
-                out_words[count++] = sym ? sym->address : 0;
-                out_words[count++] = extra;
-            } else {
-                if (sym && sym->type == SYM_EXTERNAL)
-                    add_external_use(&cpu->ext_uses, sym->name,
-                                     cpu->PC + count + BASE_ADDRESS);
-                out_words[count++] = extra;
-            }
+    } else if (ins->opcode < 0 || ins->opcode <= 4) {
+        /* two-operand instructions; unknown mnemonics are sized the same
+         * way and rejected by the second pass */
+        const char *comma = memchr(ops, ',', (size_t)len);
+        int cut = comma ? (int)(comma - ops) : len;
+        int from = 0, to = cut;
+        trim_span(ops, &from, &to);
+        decode_operand(ops + from, to - from, &ins->src, arena);
+        if (comma) {
+            from = cut + 1;
+            to = len;
+            trim_span(ops, &from, &to);
+            decode_operand(ops + from, to - from, &ins->dst, arena);
         }
+    } else {
+        decode_operand(ops, len, &ins->dst, arena);
     }
 
-    out_words[0] = word0;
-    return count;
+    if (ins->opcode >= 0)
+        ins->words[0] = (uint16_t)((ins->opcode & 0xF) << 12);
+    place_operand(ins, &ins->src, 6);
+    place_operand(ins, &ins->dst, 0);
+
+    ins->size = (unsigned char)(1 + operand_words(&ins->src) + operand_words(&ins->dst));
+    if (ins->src.mode == AM_REGISTER && ins->dst.mode == AM_REGISTER)
+        ins->size++;
 }
 
+/* Fill in the address of the symbol an operand names */
+static void resolve_operand(const Operand *op, CPUState *cpu, uint16_t *out_words) {
+    if (!op->label) return;
+    Symbol *sym = lookup_symbol(cpu->symtab, op->label);
+    if (!sym) {
+        print_error("Unknown label: %s", op->label);
+        return;
+    }
+    if (sym->type == SYM_EXTERNAL)
+        add_external_use(cpu->arena, &cpu->ext_uses, sym->name,
+                         cpu->PC + op->at + BASE_ADDRESS);
+    out_words[op->at] = sym->address;
+}
+
+/* Encode an instruction into up to MAX_INSTRUCTION_WORDS words */
+int encode_instruction(const ParsedLine *pl, CPUState *cpu, uint16_t out_words[MAX_INSTRUCTION_WORDS]) {
+    const Instruction *ins = &pl->ins;
+    if (ins->opcode < 0) {
+        print_error("Unrecognized opcode");
+        return 0;
+    }
+    memcpy(out_words, ins->words, ins->count * sizeof(uint16_t));
+    resolve_operand(&ins->src, cpu, out_words);
+    resolve_operand(&ins->dst, cpu, out_words);
+    return ins->count;
+}
@@ -11,18 +11,27 @@
 /* CPU state (registers, flags, memory pointer, program counter) */
 typedef struct {
     uint16_t *memory;     /* pointer to assembled instruction words */
-    uint16_t  PC;         /* program counter */
+    uint32_t  PC;         /* program counter (index into memory, may exceed 16 bits) */
     uint16_t  regs[8];    /* R0..R7 (unused for encoding but kept for compatibility) */
     bool      zero_flag;
     bool      sign_flag;
     SymbolTable *symtab;  /* symbol table for label resolution */
     ExternalUse *ext_uses; /* list of external symbol usages */
+    Arena       *arena;    /* storage for ext_uses nodes */
 } CPUState;
 
-/* Encode an instruction into machine words.
- * out_words must have capacity for at least 3 words.
+/* Opcode number of a mnemonic (MOV=0 .. STOP=15, see keywords.def),
+ * or -1 if it is not one */
+int opcode_to_num(const char *opc);
+
+/* Decode the operands of an instruction into pl->ins, reporting malformed
+ * numbers and matrices.  Label names are allocated from `arena`. */
+void decode_instruction(ParsedLine *pl, Arena *arena);
+
+/* Encode a decoded instruction into machine words, resolving its labels.
+ * out_words must have capacity for MAX_INSTRUCTION_WORDS words.
  * Returns the number of words encoded (>=1). */
-int encode_instruction(const ParsedLine *pl, CPUState *cpu, uint16_t out_words[3]);
+int encode_instruction(const ParsedLine *pl, CPUState *cpu, uint16_t out_words[MAX_INSTRUCTION_WORDS]);
 
 #endif /* INSTRUCTIONS_H */
 
@@ -0,0 +1,32 @@
+#include <ctype.h>
+
+#include "keywords.h"
+#include "parser.h"   /* DirectiveType values used by the table */
+
+/* One slot of the generated table; an empty slot has len 0 */
+typedef struct {
+    const char *name;   /* lower case */
+    unsigned    len;
+    KeywordKind kind;
+    int         value;
+} KeywordEntry;
+
+#include "keyword_table.h"
+
+Keyword keyword_lookup(const char *s, size_t len) {
+    Keyword none = { KW_NONE, 0 };
+    if (len == 0 || len > KEYWORD_MAX_LEN) return none;
+    const KeywordEntry *e = &keyword_table[keyword_slot(s, len, KEYWORD_SEED)];
+    if (e->len != len) return none;
+    for (size_t i = 0; i < len; i++)
+        if (tolower((unsigned char)s[i]) != e->name[i]) return none;
+    Keyword kw = { e->kind, e->value };
+    return kw;
+}
+
+Keyword keyword_lookup_str(const char *s) {
+    size_t len = 0;
+    /* anything longer than the longest keyword is not one */
+    while (s[len] && len <= KEYWORD_MAX_LEN) len++;
+    return keyword_lookup(s, len);
+}
@@ -0,0 +1,45 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* What a reserved word is */
+typedef enum {
+    KW_NONE,        /* not a reserved word */
+    KW_OPCODE,      /* value: opcode number (MOV=0 .. STOP=15) */
+    KW_DIRECTIVE,   /* value: DirectiveType (the name without its dot) */
+    KW_REGISTER     /* value: register index 0..7 */
+} KeywordKind;
+
+typedef struct {
+    KeywordKind kind;
+    int         value;
+} Keyword;
+
+/* Classify `len` bytes at `s`, ignoring case.  One hash and at most one
+ * comparison: the table is a collision-free hash built at compile time
+ * from keywords.def. */
+Keyword keyword_lookup(const char *s, size_t len);
+
+/* Same for a NUL-terminated string */
+Keyword keyword_lookup_str(const char *s);
+
+/* The table has 1 << KEYWORD_SLOT_BITS slots */
+#define KEYWORD_SLOT_BITS 6
+#define KEYWORD_SLOTS     (1 << KEYWORD_SLOT_BITS)
+
+/* Slot of a word in the table: FNV-1a over the case-folded bytes,
+ * starting from `seed`, then mixed so words that differ only in their
+ * last character (r0..r7) spread out.  Shared with tools/gen_keywords.c. */
+static inline unsigned keyword_slot(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = seed;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint32_t)((unsigned char)s[i] | 0x20)) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h >> (32 - KEYWORD_SLOT_BITS);
+}
+
+#endif /* KEYWORDS_H */
@@ -0,0 +1,112 @@
+#include "lexer.h"
+#include "scan.h"
+
+/* Every byte not listed (including 0x80-0xff) has no class */
+const unsigned char char_class[256] = {
+    [' '] = CC_SPACE,
+    ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE,
+    ['\r'] = CC_SPACE,
+    [':'] = CC_PUNCT, [','] = CC_PUNCT, [';'] = CC_END, ['\0'] = CC_END,
+#define L CC_ALPHA | CC_IDENT
+    ['A'] = L, ['B'] = L, ['C'] = L, ['D'] = L, ['E'] = L, ['F'] = L,
+    ['G'] = L, ['H'] = L, ['I'] = L, ['J'] = L, ['K'] = L, ['L'] = L,
+    ['M'] = L, ['N'] = L, ['O'] = L, ['P'] = L, ['Q'] = L, ['R'] = L,
+    ['S'] = L, ['T'] = L, ['U'] = L, ['V'] = L, ['W'] = L, ['X'] = L,
+    ['Y'] = L, ['Z'] = L,
+    ['a'] = L, ['b'] = L, ['c'] = L, ['d'] = L, ['e'] = L, ['f'] = L,
+    ['g'] = L, ['h'] = L, ['i'] = L, ['j'] = L, ['k'] = L, ['l'] = L,
+    ['m'] = L, ['n'] = L, ['o'] = L, ['p'] = L, ['q'] = L, ['r'] = L,
+    ['s'] = L, ['t'] = L, ['u'] = L, ['v'] = L, ['w'] = L, ['x'] = L,
+    ['y'] = L, ['z'] = L,
+#undef L
+#define D CC_DIGIT | CC_IDENT
+    ['0'] = D, ['1'] = D, ['2'] = D, ['3'] = D, ['4'] = D, ['5'] = D,
+    ['6'] = D, ['7'] = D, ['8'] = D, ['9'] = D,
+#undef D
+    ['_'] = CC_IDENT,
+};
+
+void lex_init(Lexer *lx, const char *src, int len) {
+    lx->src = src;
+    lx->pos = 0;
+    lx->len = len;
+    lx->block = -1;
+}
+
+/* Classify the block holding lx->pos */
+static void lex_load(Lexer *lx) {
+    const unsigned set = SCAN_SPACE | SCAN_COLON | SCAN_COMMA | SCAN_SEMI | SCAN_NUL;
+    int block = lx->pos - lx->pos % SCAN_BLOCK;
+    int n = lx->len - block;
+    lx->block = block;
+    if (n >= SCAN_BLOCK) {
+        lx->stop = scan_block(lx->src + block, set);
+    } else {
+        /* the end of the text ends a word too */
+        lx->stop = scan_tail(lx->src + block, n, set) | ~(((uint32_t)1 << n) - 1);
+    }
+}
+
+/* End of the word whose first byte is at lx->pos, from the block masks */
+static int lex_word_end(Lexer *lx) {
+    int pos = lx->pos;
+    while (pos < lx->len) {
+        if (lx->block < 0 || pos >= lx->block + SCAN_BLOCK) {
+            lx->pos = pos;
+            lex_load(lx);
+        }
+        uint32_t m = lx->stop >> (pos - lx->block);
+        if (m) {
+            pos += scan_first(m);
+            return pos < lx->len ? pos : lx->len;
+        }
+        pos = lx->block + SCAN_BLOCK;
+    }
+    return lx->len;
+}
+
+/* End of the word whose first byte is at `pos`, walking byte by byte */
+static int walk_word_end(const char *s, int pos, int len) {
+    while (pos < len && !(char_class[(unsigned char)s[pos]] & (CC_SPACE | CC_PUNCT | CC_END)))
+        pos++;
+    return pos;
+}
+
+/* Blanks between tokens are short and walked; words in lines of a block or
+ * more are measured with the scan masks, shorter lines are quicker to walk */
+bool lex_next(Lexer *lx, Token *tok) {
+    const char *s = lx->src;
+    int pos = lex_skip_space(s, lx->pos, lx->len);
+    if (pos >= lx->len || (char_class[(unsigned char)s[pos]] & CC_END)) {
+        lx->pos = lx->len;
+        return false;
+    }
+    tok->off = pos;
+    if (char_class[(unsigned char)s[pos]] & CC_PUNCT) {
+        tok->kind = s[pos] == ':' ? TOK_COLON : TOK_COMMA;
+        pos++;
+    } else if (lx->len < SCAN_BLOCK) {
+        tok->kind = TOK_WORD;
+        pos = walk_word_end(s, pos + 1, lx->len);
+    } else {
+        tok->kind = TOK_WORD;
+        lx->pos = pos + 1;
+        pos = lex_word_end(lx);
+    }
+    tok->len = pos - tok->off;
+    lx->pos = pos;
+    return true;
+}
+
+int lex_word_len(const char *src, int off, int end, int max) {
+    int n = 0;
+    while (off + n < end && n < max && !is_space_char(src[off + n]))
+        n++;
+    return n;
+}
+
+int lex_skip_space(const char *src, int off, int end) {
+    while (off < end && is_space_char(src[off]))
+        off++;
+    return off;
+}
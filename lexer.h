@@ -0,0 +1,62 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Byte classes of the source character set.  The table is plain ASCII, so
+ * lexing never depends on the locale the way isspace() and isalpha() do. */
+enum {
+    CC_SPACE = 1 << 0,   /* ' ' \t \n \v \f \r */
+    CC_ALPHA = 1 << 1,   /* A-Z a-z */
+    CC_DIGIT = 1 << 2,   /* 0-9 */
+    CC_IDENT = 1 << 3,   /* letters, digits and '_' */
+    CC_PUNCT = 1 << 4,   /* ':' and ',' : tokens of their own */
+    CC_END   = 1 << 5    /* ';' (comment) and NUL: end of the statement */
+};
+
+extern const unsigned char char_class[256];
+
+static inline bool is_space_char(char c) {
+    return char_class[(unsigned char)c] & CC_SPACE;
+}
+
+typedef enum {
+    TOK_WORD,    /* run of bytes that are not space, punctuation or end */
+    TOK_COLON,
+    TOK_COMMA
+} TokenKind;
+
+/* One token: `len` bytes at `off` in the lexed text; nothing is copied */
+typedef struct {
+    TokenKind kind;
+    int       off;
+    int       len;
+} Token;
+
+/* In long lines the lexer classifies SCAN_BLOCK bytes at a time (see
+ * scan.h) and finds the end of each word with bit operations on the mask */
+typedef struct {
+    const char *src;
+    int         pos;
+    int         len;
+    int         block;   /* offset of the classified block, or -1 */
+    uint32_t    stop;    /* bytes of the block that end a word: blanks, ':',
+                            ',', ';', NUL and anything past `len` */
+} Lexer;
+
+/* Lex `len` bytes at `src` (no NUL terminator needed) */
+void lex_init(Lexer *lx, const char *src, int len);
+
+/* Store the next token in `tok`; false at the end of the text or at the
+ * start of a comment */
+bool lex_next(Lexer *lx, Token *tok);
+
+/* Length of the run of non-space bytes at src[off], stopping at `end` and
+ * after at most `max` bytes (what sscanf's "%<max>s" would read) */
+int  lex_word_len(const char *src, int off, int end, int max);
+
+/* Offset of the first non-space byte at or after `off`, or `end` */
+int  lex_skip_space(const char *src, int off, int end);
+
+#endif /* LEXER_H */
@@ -8,189 +8,572 @@
 #include "macro.h"
 #include "utils.h"   /* trim_string, split_string */
 #include "error.h"   /* print_error */
+#include "parser.h"  /* parse_line */
+#include "stats.h"
 
 #define INITIAL_BODY_CAP 8
+#define MACRO_MIN_SLOTS  64
 
 /* Initialize macro table */
-void init_macro_table(MacroTable *mt) {
+void init_macro_table(MacroTable *mt, Arena *arena) {
+    mt->macros = NULL;
     mt->count = 0;
+    mt->cap = 0;
+    mt->slots = NULL;
+    mt->slot_mask = 0;
+    mt->arena = arena;
 }
 
-/* Free any dynamically allocated memory inside the macro table */
+/* Forget all macros; bodies and expansions are released with the arena */
 void free_macro_table(MacroTable *mt) {
+    init_macro_table(mt, mt->arena);
+}
+
+/* FNV-1a over `len` bytes */
+static uint32_t hash_name(const char *name, int len) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+/* Index slot holding `name`, or the empty slot where it would go */
+static int *find_slot(const MacroTable *mt, const char *name, int len, uint32_t hash) {
+    uint32_t i = hash & mt->slot_mask;
+    for (;;) {
+        int *slot = &mt->slots[i];
+        if (*slot == 0) return slot;
+        const MacroDef *md = mt->macros[*slot - 1];
+        if (md->hash == hash && md->name_len == len && memcmp(md->name, name, len) == 0)
+            return slot;
+        i = (i + 1) & mt->slot_mask;
+    }
+}
+
+/* Helper: find macro definition by name (name need not be NUL-terminated) */
+static MacroDef *find_macro(const MacroTable *mt, const char *name, int len) {
+    if (mt->count == 0) return NULL;
+    int slot = *find_slot(mt, name, len, hash_name(name, len));
+    return slot ? mt->macros[slot - 1] : NULL;
+}
+
+/* Make room for one more macro: grow the list, and the index so that it
+ * stays at most half full */
+static void reserve_macro(MacroTable *mt) {
+    if (mt->count >= mt->cap) {
+        int cap = mt->cap ? mt->cap * 2 : 16;
+        MacroDef **macros = arena_alloc(mt->arena, sizeof(MacroDef*) * cap);
+        if (!macros) error_exit("Memory allocation failed");
+        if (mt->count) memcpy(macros, mt->macros, sizeof(MacroDef*) * mt->count);
+        mt->macros = macros;
+        mt->cap = cap;
+    }
+    if (mt->slots && (uint32_t)(mt->count + 1) * 2 <= mt->slot_mask + 1)
+        return;
+    uint32_t nslots = mt->slots ? (mt->slot_mask + 1) * 2 : MACRO_MIN_SLOTS;
+    mt->slots = arena_alloc(mt->arena, sizeof(int) * nslots);
+    if (!mt->slots) error_exit("Memory allocation failed");
+    memset(mt->slots, 0, sizeof(int) * nslots);
+    mt->slot_mask = nslots - 1;
     for (int i = 0; i < mt->count; i++) {
-        MacroDef *md = &mt->macros[i];
-        for (int j = 0; j < md->body_len; j++) {
-            free(md->body[j]);
-            md->body[j] = NULL;
+        const MacroDef *md = mt->macros[i];
+        *find_slot(mt, md->name, md->name_len, md->hash) = i + 1;
+    }
+}
+
+/* Is the (trimmed) line a “MACRO name …” header? */
+static bool is_macro_header(const char *s, int len) {
+    return len > 5 && strncasecmp(s, "MACRO", 5)==0 && isspace((unsigned char)s[5]);
+}
+
+/* Is the (trimmed) line the “ENDM” terminator? */
+static bool is_macro_end(const char *s, int len) {
+    return len == 4 && strncasecmp(s, "ENDM", 4)==0;
+}
+
+/* Parse a “MACRO name p1,p2…” header into a new table entry.
+ * Returns NULL (after reporting) if the header is invalid.  A second
+ * definition of a name gets an entry of its own, but invocations keep
+ * using the first one. */
+static MacroDef *begin_macro(MacroTable *mt, const char *s, int len) {
+    char *buf = arena_strndup(mt->arena, s, len);
+    if (!buf) error_exit("Memory allocation failed");
+    char *p = buf + 5;
+    trim_string(p);
+    char *save;
+    char *tok = strtok_r(p, " \t", &save);
+    if (!tok) { print_error("Invalid MACRO header"); return NULL; }
+    MacroDef *md = arena_alloc(mt->arena, sizeof(MacroDef));
+    if (!md) error_exit("Memory allocation failed");
+    md->name = tok;
+    md->name_len = (int)strlen(tok);
+    md->hash = hash_name(tok, md->name_len);
+    md->body_len = 0;
+    md->body_cap = INITIAL_BODY_CAP;
+    md->body = arena_alloc(mt->arena, sizeof(MacroLine) * md->body_cap);
+    if (!md->body) error_exit("Memory allocation failed");
+
+    /* parse params if any */
+    char *plist = strtok_r(NULL, "", &save);
+    md->param_count = 0;
+    md->params = NULL;
+    md->param_lens = NULL;
+    if (plist) {
+        int n = 1;
+        for (const char *c = plist; *c; c++)
+            if (*c == ',') n++;
+        md->params = arena_alloc(mt->arena, sizeof(char*) * n);
+        md->param_lens = arena_alloc(mt->arena, sizeof(int) * n);
+        if (!md->params || !md->param_lens) error_exit("Memory allocation failed");
+        char *p2 = strtok_r(plist, ",", &save);
+        while (p2) {
+            trim_string(p2);
+            md->params[md->param_count] = p2;
+            md->param_lens[md->param_count++] = (int)strlen(p2);
+            p2 = strtok_r(NULL, ",", &save);
         }
-        free(md->body);
-        md->body = NULL;
-        md->body_len = 0;
-        md->body_cap = 0;
-        md->param_count = 0;
     }
-    mt->count = 0;
+
+    reserve_macro(mt);
+    int *slot = find_slot(mt, md->name, md->name_len, md->hash);
+    mt->macros[mt->count++] = md;
+    if (*slot == 0) *slot = mt->count;
+    return md;
 }
 
-/* Helper: find macro definition by name */
-static MacroDef *find_macro(MacroTable *mt, const char *name) {
-    for (int i = 0; i < mt->count; i++)
-        if (strcmp(mt->macros[i].name, name) == 0)
-            return &mt->macros[i];
-    return NULL;
+/* Index of the parameter whose %name% starts at `p`, or -1 */
+static int match_param(const MacroDef *md, const char *p, const char *end) {
+    for (int pi = 0; pi < md->param_count; pi++) {
+        int n = md->param_lens[pi];
+        if (end - p >= n + 2 && p[n + 1] == '%' &&
+            memcmp(p + 1, md->params[pi], n) == 0)
+            return pi;
+    }
+    return -1;
+}
+
+/* Split `len` bytes at `text` (kept in the arena) into literal text and
+ * %param% slots */
+static void compile_template(Arena *arena, const MacroDef *md, MacroTemplate *t,
+                             const char *text, int len) {
+    const char *end = text + len;
+
+    /* every slot takes at least two '%', so this bounds the pieces */
+    int max_pieces = 1;
+    for (const char *c = text; c < end; c++)
+        if (*c == '%') max_pieces++;
+    t->pieces = arena_alloc(arena, sizeof(MacroPiece) * max_pieces);
+    if (!t->pieces) error_exit("Memory allocation failed");
+    t->piece_count = 0;
+    t->literal_len = 0;
+
+    const char *lit = text;
+    const char *p = text;
+    while (p < end) {
+        int pi = *p == '%' ? match_param(md, p, end) : -1;
+        if (pi < 0) { p++; continue; }
+        MacroPiece *piece = &t->pieces[t->piece_count++];
+        piece->text = lit;
+        piece->len = (int)(p - lit);
+        piece->param = pi;
+        t->literal_len += piece->len;
+        p += md->param_lens[pi] + 2;
+        lit = p;
+    }
+    MacroPiece *last = &t->pieces[t->piece_count++];
+    last->text = lit;
+    last->len = (int)(end - lit);
+    last->param = -1;
+    t->literal_len += last->len;
+}
+
+static void discard_message(void *user, const Diagnostic *d) {
+    (void)user;
+    (void)d;
+}
+
+/*
+ * Parse a body line once, if its parameters all sit among the operands.
+ * The part before the first slot decides the label, statement type and
+ * opcode exactly as it would after substitution, as long as no ':' or ';'
+ * follows it (arguments are checked for those when expanding).  Lines that
+ * do not parse are left to be parsed, and reported, at every expansion.
+ */
+static void compile_statement(Arena *arena, const MacroDef *md, MacroLine *ml,
+                              const char *text, int len) {
+    ml->stmt = NULL;
+    for (int pi = 0; pi < md->param_count; pi++)
+        if (strpbrk(md->params[pi], ":;")) return;
+
+    const char *semi = memchr(text, ';', (size_t)len);
+    int code_len = semi ? (int)(semi - text) : len;
+    int head_len = code_len;
+    for (int i = 0; i < code_len; i++) {
+        if (text[i] == '%' && match_param(md, text + i, text + code_len) >= 0) {
+            head_len = i;
+            break;
+        }
+    }
+    if (memchr(text + head_len, ':', (size_t)(code_len - head_len))) return;
+
+    /* a failed parse is not an error here: keep it quiet */
+    ErrorSink quiet, *prev = error_bound_sink();
+    error_sink_init(&quiet);
+    quiet.callback = discard_message;
+    quiet.recover = prev ? prev->recover : NULL;
+    error_bind_sink(&quiet);
+    ParsedLine pl;
+    bool ok = parse_line(text, head_len, &pl, 0, arena);
+    error_bind_sink(prev);
+    error_sink_free(&quiet);
+    if (!ok) return;
+
+    const char *args = pl.type == STMT_INSTRUCTION ? pl.operands_raw :
+                       pl.type == STMT_DIRECTIVE   ? pl.directive_args : NULL;
+    if (head_len < code_len) {
+        /* the opcode or directive name must end before the first slot */
+        if (!args) return;
+        if (args[0] == '\0' && !isspace((unsigned char)text[head_len - 1])) return;
+    }
+    if (args) {
+        /* the operands start where the parsed ones did and run to the comment */
+        int args_end = head_len;
+        while (args_end > 0 && isspace((unsigned char)text[args_end - 1])) args_end--;
+        int args_start = args_end - (int)strlen(args);
+        compile_template(arena, md, &ml->operands, text + args_start, code_len - args_start);
+    }
+    ml->stmt = arena_alloc(arena, sizeof(ParsedLine));
+    if (!ml->stmt) error_exit("Memory allocation failed");
+    *ml->stmt = pl;
+}
+
+/* Compile a body line into its text template and, if it can be, a parsed
+ * statement */
+static void compile_body_line(Arena *arena, const MacroDef *md, MacroLine *ml,
+                              const char *s, int len) {
+    char *text = arena_strndup(arena, s, len);
+    if (!text) error_exit("Memory allocation failed");
+    compile_template(arena, md, &ml->text, text, len);
+    compile_statement(arena, md, ml, text, len);
+}
+
+/* Append one (already trimmed) body line to a macro */
+static void add_body_line(Arena *arena, MacroDef *md, const char *s, int len) {
+    if (md->body_len >= md->body_cap) {
+        md->body_cap *= 2;
+        MacroLine *tmp_arr = arena_alloc(arena, sizeof(MacroLine) * md->body_cap);
+        if (!tmp_arr) error_exit("Memory allocation failed");
+        memcpy(tmp_arr, md->body, sizeof(MacroLine) * md->body_len);
+        md->body = tmp_arr;
+    }
+    compile_body_line(arena, md, &md->body[md->body_len], s, len);
+    md->body_len++;
+}
+
+/* Split the argument list of an invocation in place into `args` */
+static void split_macro_args(char *aplist, MacroArgs *args) {
+    args->count = 0;
+    args->plain = true;
+    if (!aplist) return;
+    char *save;
+    char *p = strtok_r(aplist, ",", &save);
+    while (p) {
+        if (args->count >= args->cap) {
+            args->cap = args->cap ? args->cap * 2 : 8;
+            char **v = realloc(args->v, sizeof(char*) * args->cap);
+            if (v) args->v = v;
+            int *lens = realloc(args->len, sizeof(int) * args->cap);
+            if (lens) args->len = lens;
+            if (!v || !lens) error_exit("Memory allocation failed");
+        }
+        trim_string(p);
+        if (strpbrk(p, ":;")) args->plain = false;
+        args->v[args->count] = p;
+        args->len[args->count++] = (int)strlen(p);
+        p = strtok_r(NULL, ",", &save);
+    }
+}
+
+static void free_macro_args(MacroArgs *args) {
+    free(args->v);
+    free(args->len);
+    memset(args, 0, sizeof(*args));
+}
+
+/* Substitute `args` into `t`, in `arena`: one allocation of exactly the
+ * output size and one pass over the pieces */
+static char *expand_template(Arena *arena, const MacroTemplate *t,
+                             const MacroArgs *args, int *len_out) {
+    int len = t->literal_len, slots = 0;
+    for (int i = 0; i < t->piece_count; i++) {
+        if (t->pieces[i].param >= 0) {
+            len += args->len[t->pieces[i].param];
+            slots++;
+        }
+    }
+    stats_count(STAT_MACRO_SUBSTITUTIONS, slots);
+
+    char *line = arena_alloc(arena, (size_t)len + 1);
+    if (!line) error_exit("Memory allocation failed");
+    char *w = line;
+    for (int i = 0; i < t->piece_count; i++) {
+        const MacroPiece *piece = &t->pieces[i];
+        memcpy(w, piece->text, piece->len);
+        w += piece->len;
+        if (piece->param >= 0) {
+            memcpy(w, args->v[piece->param], args->len[piece->param]);
+            w += args->len[piece->param];
+        }
+    }
+    *w = '\0';
+    *len_out = len;
+    return line;
+}
+
+/* Produce body line `b` of `md` for an invocation with `args`, in `arena`:
+ * a parsed statement when the line has one, otherwise its text */
+static void expand_body_line(Arena *arena, const MacroDef *md, int b,
+                             const MacroArgs *args, LineView *out) {
+    const MacroLine *ml = &md->body[b];
+    if (!ml->stmt || !args->plain) {
+        out->ptr = expand_template(arena, &ml->text, args, &out->len);
+        out->parsed = NULL;
+        return;
+    }
+
+    ParsedLine *pl = arena_alloc(arena, sizeof(ParsedLine));
+    if (!pl) error_exit("Memory allocation failed");
+    *pl = *ml->stmt;
+    if (pl->operands_raw || pl->directive_args) {
+        int len;
+        const char *text = expand_template(arena, &ml->operands, args, &len);
+        trim_view(&text, &len);
+        char *trimmed = (char *)text;
+        trimmed[len] = '\0';
+        if (pl->operands_raw) pl->operands_raw = trimmed;
+        else pl->directive_args = trimmed;
+    }
+    out->ptr = "";
+    out->len = 0;
+    out->parsed = pl;
+}
+
+/* Locate the macro named by the first token of a trimmed line, and the
+ * start of its argument list (NULL if there is none). */
+static MacroDef *match_invocation(const MacroTable *mt, const char *s, int len,
+                                  const char **args_out, int *args_len) {
+    int tok_len = 0;
+    while (tok_len < len && s[tok_len] != ' ' && s[tok_len] != '\t')
+        tok_len++;
+    MacroDef *md = find_macro(mt, s, tok_len);
+    *args_out = NULL;
+    *args_len = 0;
+    if (md && tok_len < len) {
+        *args_out = s + tok_len + 1;
+        *args_len = len - tok_len - 1;
+    }
+    return md;
 }
 
 /* Scan once for “MACRO name p1,p2… “ until “ENDM” */
-bool scan_macros(const char *lines[], int line_count, MacroTable *mt) {
+bool scan_macros(const LineView lines[], int line_count, MacroTable *mt) {
+    ErrorSink *diag = error_bound_sink();
     for (int i = 0; i < line_count; i++) {
-        char *buf = strdup(lines[i]);
-        if (!buf) error_exit("Memory allocation failed");
-        trim_string(buf);
-        if (strncasecmp(buf, "MACRO", 5)==0 && isspace((unsigned char)buf[5])) {
-            if (mt->count >= MAX_MACROS) {
-                print_error("Too many macros");
-                free(buf);
-                return false;
-            }
-            /* parse header: MACRO name param,param… */
-            char *p = buf + 5;
-            trim_string(p);
-            char *tok = strtok(p, " \t");
-            if (!tok) { print_error("Invalid MACRO header"); free(buf); return false; }
-            MacroDef *md = &mt->macros[mt->count++];
-            strncpy(md->name, tok, MAX_MACRO_NAME-1);
-            md->body_len = 0;
-            md->body_cap = INITIAL_BODY_CAP;
-            md->body = malloc(sizeof(char*) * md->body_cap);
-            if (!md->body) error_exit("Memory allocation failed");
-
-            /* parse params if any */
-            char *plist = strtok(NULL, "");
-            md->param_count = 0;
-            if (plist) {
-                char *p2 = strtok(plist, ",");
-                while (p2 && md->param_count<MAX_MACRO_PARAMS) {
-                    trim_string(p2);
-                    strncpy(md->params[md->param_count++], p2, MAX_MACRO_NAME-1);
-                    p2 = strtok(NULL, ",");
-                }
-            }
+        const char *s = lines[i].ptr;
+        int len = lines[i].len;
+        trim_view(&s, &len);
+        if (is_macro_header(s, len)) {
+            error_sink_at(diag, lines[i].line_no);
+            MacroDef *md = begin_macro(mt, s, len);
+            if (!md) return false;
             /* collect body until ENDM */
             int j = i+1;
             for (; j < line_count; j++) {
-                char *tmp = strdup(lines[j]);
-                if (!tmp) error_exit("Memory allocation failed");
-                trim_string(tmp);
-                if (strcasecmp(tmp, "ENDM")==0) {
-                    free(tmp);
+                const char *b = lines[j].ptr;
+                int blen = lines[j].len;
+                trim_view(&b, &blen);
+                if (is_macro_end(b, blen))
                     break;
-                }
-                if (md->body_len >= md->body_cap) {
-                    md->body_cap *= 2;
-                    char **tmp_arr = realloc(md->body, sizeof(char*) * md->body_cap);
-                    if (!tmp_arr) error_exit("Memory allocation failed");
-                    md->body = tmp_arr;
-                }
-                md->body[md->body_len] = tmp;
-                md->body_len++;
+                add_body_line(mt->arena, md, b, blen);
             }
             if (j>=line_count) {
                 print_error("Missing ENDM for MACRO");
-                free(buf);
                 return false;
             }
             i = j;  /* continue after ENDM */
         }
-        free(buf);
     }
     return true;
 }
 
+/* Append one view to the growing output array */
+static void push_line(LineView **out, size_t *cap, int *oc, LineView line) {
+    if ((size_t)*oc >= *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        LineView *tmp = realloc(*out, sizeof(LineView) * *cap);
+        if (!tmp) error_exit("Memory allocation failed");
+        *out = tmp;
+    }
+    (*out)[(*oc)++] = line;
+}
+
 /* Replace each macro invocation with its body, substituting params */
-char **expand_macros(const char *lines[], int in_count, int *out_count, MacroTable *mt) {
+LineView *expand_macros(const LineView lines[], int in_count, int *out_count, MacroTable *mt) {
     size_t cap = in_count;
-    char **out = malloc(sizeof(char*) * cap);
+    LineView *out = malloc(sizeof(LineView) * (cap ? cap : 1));
     if (!out) error_exit("Memory allocation failed");
     int oc = 0;
+    MacroArgs args = {0};
+    ErrorSink *diag = error_bound_sink();
 
     for (int i = 0; i < in_count; i++) {
-        char *buf = strdup(lines[i]);
-        if (!buf) error_exit("Memory allocation failed");
-        trim_string(buf);
-        if (buf[0]=='\0') {
-            if ((size_t)oc >= cap) {
-                cap *= 2;
-                char **tmp = realloc(out, sizeof(char*) * cap);
-                if (!tmp) error_exit("Memory allocation failed");
-                out = tmp;
+        const char *s = lines[i].ptr;
+        int len = lines[i].len;
+        trim_view(&s, &len);
+        if (len == 0) {
+            LineView empty = { s, 0, lines[i].line_no, NULL };
+            push_line(&out, &cap, &oc, empty);
+            continue;
+        }
+        /* definitions were collected by scan_macros: drop them from the output */
+        if (is_macro_header(s, len)) {
+            while (i + 1 < in_count) {
+                const char *b = lines[++i].ptr;
+                int blen = lines[i].len;
+                trim_view(&b, &blen);
+                if (is_macro_end(b, blen)) break;
             }
-            out[oc++] = strdup(buf);
-            free(buf);
             continue;
         }
         /* check first token = macro name? */
-        char *tok = strtok(buf, " \t");
-        MacroDef *md = find_macro(mt, tok);
+        const char *arg_text;
+        int arg_len;
+        MacroDef *md = match_invocation(mt, s, len, &arg_text, &arg_len);
         if (!md) {
-            if ((size_t)oc >= cap) {
-                cap *= 2;
-                char **tmp = realloc(out, sizeof(char*) * cap);
-                if (!tmp) error_exit("Memory allocation failed");
-                out = tmp;
-            }
-            out[oc++] = strdup(lines[i]);
+            push_line(&out, &cap, &oc, lines[i]);
+            continue;
+        }
+
+        /* parse arguments on invocation */
+        char *aplist = NULL;
+        if (arg_text) {
+            aplist = arena_strndup(mt->arena, arg_text, arg_len);
+            if (!aplist) error_exit("Memory allocation failed");
+        }
+        split_macro_args(aplist, &args);
+        /* validate argument count */
+        if (args.count != md->param_count) {
+            error_sink_at(diag, lines[i].line_no);
+            print_error("Macro %s expects %d parameters but got %d", md->name, md->param_count, args.count);
+            push_line(&out, &cap, &oc, lines[i]);
         } else {
-            /* parse arguments on invocation */
-            char *aplist = strtok(NULL, "");
-            char *args[MAX_MACRO_PARAMS];
-            int ac=0;
-            if (aplist) {
-                char *p = strtok(aplist, ",");
-                while (p && ac<MAX_MACRO_PARAMS) {
-                    trim_string(p);
-                    args[ac++] = p;
-                    p = strtok(NULL, ",");
-                }
-            }
-            /* validate argument count */
-            if (ac != md->param_count) {
-                print_error("Macro %s expects %d parameters but got %d", md->name, md->param_count, ac);
-                if ((size_t)oc >= cap) {
-                    cap *= 2;
-                    char **tmp_arr = realloc(out, sizeof(char*) * cap);
-                    if (!tmp_arr) error_exit("Memory allocation failed");
-                    out = tmp_arr;
-                }
-                out[oc++] = strdup(lines[i]);
-            } else {
-                /* for each body line, substitute %param% */
-                for (int b=0; b<md->body_len; b++) {
-                    char *tmp = strdup(md->body[b]);
-                    if (!tmp) error_exit("Memory allocation failed");
-                    for (int pi=0; pi<md->param_count; pi++) {
-                        char pattern[64], repl[64];
-                        snprintf(pattern, sizeof(pattern), "%%%s%%", md->params[pi]);
-                        snprintf(repl, sizeof(repl), "%s", (pi<ac?args[pi]:""));
-                        char *repl_tmp = replace_substring(tmp, pattern, repl);
-                        free(tmp);
-                        if (!repl_tmp) error_exit("Memory allocation failed");
-                        tmp = repl_tmp;
-                    }
-                    if ((size_t)oc >= cap) {
-                        cap *= 2;
-                        char **tmp_arr = realloc(out, sizeof(char*) * cap);
-                        if (!tmp_arr) error_exit("Memory allocation failed");
-                        out = tmp_arr;
-                    }
-                    out[oc++] = tmp;
-                }
+            /* for each body line, substitute %param% */
+            stats_count(STAT_MACRO_INVOCATIONS, 1);
+            for (int b=0; b<md->body_len; b++) {
+                LineView v;
+                expand_body_line(mt->arena, md, b, &args, &v);
+                v.line_no = lines[i].line_no;
+                push_line(&out, &cap, &oc, v);
             }
         }
-        free(buf);
     }
 
+    free_macro_args(&args);
     *out_count = oc;
     return out;
 }
 
+/* the per-line scratch arena of a stream only ever holds one expanded line */
+#define STREAM_SCRATCH_CHUNK 4096
+
+void init_macro_stream(MacroStream *ms, MacroTable *mt, FILE *in) {
+    memset(ms, 0, sizeof(*ms));
+    ms->mt = mt;
+    ms->in = in;
+    arena_init(&ms->scratch, STREAM_SCRATCH_CHUNK);
+}
+
+void free_macro_stream(MacroStream *ms) {
+    free(ms->buf);
+    free(ms->arg_buf);
+    free_macro_args(&ms->args);
+    arena_free(&ms->scratch);
+    memset(ms, 0, sizeof(*ms));
+}
+
+/* Read the next raw source line into ms->buf; returns its trimmed view */
+static bool stream_read_line(MacroStream *ms, const char **s, int *len) {
+    ssize_t n = getline(&ms->buf, &ms->buf_cap, ms->in);
+    if (n < 0) return false;
+    ms->line_no++;
+    *s = ms->buf;
+    *len = (int)n;
+    trim_view(s, len);
+    return true;
+}
+
+bool macro_stream_next(MacroStream *ms, LineView *out) {
+    arena_reset(&ms->scratch);
+
+    for (;;) {
+        /* keep yielding the body of the invocation being expanded */
+        if (ms->active) {
+            if (ms->body_pos < ms->active->body_len) {
+                expand_body_line(&ms->scratch, ms->active, ms->body_pos++, &ms->args, out);
+                out->line_no = ms->active_line;
+                return true;
+            }
+            ms->active = NULL;
+            free(ms->arg_buf);
+            ms->arg_buf = NULL;
+        }
+
+        const char *s;
+        int len;
+        if (!stream_read_line(ms, &s, &len)) return false;
+
+        if (is_macro_header(s, len)) {
+            error_sink_at(error_bound_sink(), ms->line_no);
+            MacroDef *md = begin_macro(ms->mt, s, len);
+            if (!md) { ms->failed = true; return false; }
+            const char *b;
+            int blen;
+            bool closed = false;
+            while (stream_read_line(ms, &b, &blen)) {
+                if (is_macro_end(b, blen)) { closed = true; break; }
+                add_body_line(ms->mt->arena, md, b, blen);
+            }
+            if (!closed) {
+                print_error("Missing ENDM for MACRO");
+                ms->failed = true;
+                return false;
+            }
+            continue;
+        }
+
+        const char *arg_text = NULL;
+        int arg_len = 0;
+        MacroDef *md = len ? match_invocation(ms->mt, s, len, &arg_text, &arg_len) : NULL;
+        if (md) {
+            ms->arg_buf = arg_text ? strndup(arg_text, arg_len) : NULL;
+            if (arg_text && !ms->arg_buf) error_exit("Memory allocation failed");
+            split_macro_args(ms->arg_buf, &ms->args);
+            if (ms->args.count == md->param_count) {
+                stats_count(STAT_MACRO_INVOCATIONS, 1);
+                ms->active = md;
+                ms->body_pos = 0;
+                ms->active_line = ms->line_no;
+                continue;
+            }
+            error_sink_at(error_bound_sink(), ms->line_no);
+            print_error("Macro %s expects %d parameters but got %d", md->name, md->param_count, ms->args.count);
+            free(ms->arg_buf);
+            ms->arg_buf = NULL;
+        }
+        out->ptr = s;
+        out->len = len;
+        out->line_no = ms->line_no;
+        out->parsed = NULL;
+        return true;
+    }
+}
@@ -2,35 +2,115 @@
 #define MACRO_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
-#define MAX_MACRO_NAME   32
-#define MAX_MACRO_PARAMS  8
-#define MAX_MACROS      64
+#include "source.h"  /* LineView */
+#include "arena.h"   /* Arena */
 
-/* One macro definition */
+/* Part of a compiled body line: literal text, then optionally the
+ * argument of one parameter */
 typedef struct {
-    char        name[MAX_MACRO_NAME];
-    int         param_count;
-    char        params[MAX_MACRO_PARAMS][MAX_MACRO_NAME];
-    char      **body;        /* dynamically sized array of body lines */
-    int         body_len;    /* number of used entries in body */
-    int         body_cap;    /* allocated capacity of body */
+    const char *text;         /* literal bytes, in the table's arena */
+    int         len;
+    int         param;        /* parameter index, or -1 at the end of the line */
+} MacroPiece;
+
+/* Text compiled once, when the macro is defined, so expanding it is a
+ * single copy into a buffer of known size */
+typedef struct {
+    MacroPiece *pieces;
+    int         piece_count;
+    int         literal_len;  /* sum of the pieces' literal lengths */
+} MacroTemplate;
+
+struct ParsedLine;
+
+/*
+ * One body line.  When the parameters can only appear among its operands,
+ * the line is also parsed at definition time: an invocation then copies
+ * `stmt` and fills in `operands`, and never lexes the line again.
+ */
+typedef struct {
+    MacroTemplate      text;      /* the whole line */
+    struct ParsedLine *stmt;      /* the line parsed up to its operands, or NULL */
+    MacroTemplate      operands;  /* operand or directive argument text of stmt */
+} MacroLine;
+
+/* One macro definition; all of it lives in the table's arena */
+typedef struct {
+    char        *name;
+    int          name_len;
+    uint32_t     hash;        /* hash of name, checked before comparing */
+    int          param_count;
+    char       **params;      /* param_count parameter names */
+    int         *param_lens;
+    MacroLine   *body;        /* array of compiled body lines */
+    int          body_len;    /* number of used entries in body */
+    int          body_cap;    /* allocated capacity of body */
 } MacroDef;
 
-/* A table of all macros in this file */
+/* Arguments of one invocation, split in place */
+typedef struct {
+    char **v;
+    int   *len;
+    int    count;
+    int    cap;
+    bool   plain;   /* no argument holds ':' or ';', which would change how
+                       the expanded line parses */
+} MacroArgs;
+
+/*
+ * All macros of one file, with no limit on their number, parameters or
+ * name length.  Definitions are kept in order and found by name through an
+ * open-addressing hash index, so checking whether a line starts with a
+ * macro name costs one probe rather than a scan of every macro.
+ */
 typedef struct {
-    MacroDef macros[MAX_MACROS];
-    int       count;
+    MacroDef **macros;        /* in definition order */
+    int        count;
+    int        cap;
+    int       *slots;         /* index: position in macros + 1, or 0 if empty */
+    uint32_t   slot_mask;     /* slot count - 1; the slot count is a power of two */
+    Arena     *arena;         /* definitions, body lines and expanded text live here */
 } MacroTable;
 
 /* Public API: */
-void     init_macro_table(MacroTable *mt);
-/* Release memory used by macros and reset the table */
+void     init_macro_table(MacroTable *mt, Arena *arena);
+/* Forget all macros (their storage belongs to the arena) */
 void     free_macro_table(MacroTable *mt);
-bool     scan_macros(const char *lines[], int line_count, MacroTable *mt);
-/* Take input lines + macro table → produce output lines (caller frees) */
-char   **expand_macros(const char *lines[], int in_count, int *out_count, MacroTable *mt);
+bool     scan_macros(const LineView lines[], int line_count, MacroTable *mt);
+/* Take input lines + macro table → produce output line views.
+ * Lines that are not macro invocations are passed through as the same view;
+ * expanded lines point into text, or carry a parsed statement, in the
+ * table's arena. The caller frees only the returned array. */
+LineView *expand_macros(const LineView lines[], int in_count, int *out_count, MacroTable *mt);
+
+/*
+ * Pull-style expansion for streaming input: each call yields the next line
+ * of the expanded program, reading the source only as far as needed.
+ * Unlike scan_macros/expand_macros, a macro must be defined before use.
+ */
+typedef struct {
+    MacroTable     *mt;
+    FILE           *in;
+    char           *buf;          /* current source line (getline buffer) */
+    size_t          buf_cap;
+    int             line_no;
+    const MacroDef *active;       /* invocation being expanded, or NULL */
+    int             body_pos;     /* next body line of `active` */
+    int             active_line;  /* source line of that invocation */
+    char           *arg_buf;      /* storage behind args */
+    MacroArgs       args;         /* arguments of the active invocation */
+    Arena           scratch;      /* holds the last expanded line */
+    bool            failed;       /* a macro definition was malformed */
+} MacroStream;
+
+void     init_macro_stream(MacroStream *ms, MacroTable *mt, FILE *in);
+/* Yield the next expanded line. The view stays valid until the next call.
+ * Returns false at end of input, or on a malformed definition (ms->failed). */
+bool     macro_stream_next(MacroStream *ms, LineView *out);
+void     free_macro_stream(MacroStream *ms);
 
 #endif /* MACRO_H */
 
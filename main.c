@@ -3,166 +3,256 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include "utils.h"
-#include "macro.h"
-#include "parser.h"
 #include "symbol_table.h"
 #include "output.h"
 #include "error.h"
-#include "second_pass.h"
-#include "data_segment.h"
-
-
-/* Read whole file into a lines[] array */
-static bool read_input(const char *fname, char ***out_lines, int *out_n) {
-    FILE *f = fopen(fname, "r");
-    if (!f) { perror("open"); return false; }
-
-    size_t capacity = 16;
-    char **lines = malloc(sizeof(*lines) * capacity);
-    if (!lines) { fclose(f); return false; }
-
-    int n = 0;
-    char *buf = NULL;
-    size_t bufsize = 0;
-    ssize_t read;
-    while ((read = getline(&buf, &bufsize, f)) != -1) {
-        if (n >= (int)capacity) {
-            capacity *= 2;
-            char **tmp = realloc(lines, sizeof(*tmp) * capacity);
-            if (!tmp) {
-                for (int i = 0; i < n; i++) free(lines[i]);
-                free(lines);
-                free(buf);
-                fclose(f);
-                return false;
-            }
-            lines = tmp;
-        }
-        lines[n] = strdup(buf);
-        free(buf);
-        buf = NULL;
-        if (!lines[n]) {
-            for (int i = 0; i < n; i++) free(lines[i]);
-            free(lines);
-            fclose(f);
-            return false;
-        }
-        n++;
-    }
-
-    free(buf);
+#include "source.h"
+#include "stream.h"
+#include "arena.h"
+#include "batch.h"
+#include "serve.h"
+#include "assemble.h"
+#include "cache.h"
+#include "objfile.h"
+#include "stats.h"
 
-    fclose(f);
-    *out_lines = lines;
-    *out_n = n;
-    return true;
-}
-
-static bool assemble_file(const char *fname) {
-    bool ok = false;
-    char **raw = NULL; int raw_n = 0;
-    char **flat = NULL; int flat_n = 0;
-    MacroTable mt; init_macro_table(&mt);
-    SymbolTable st; init_symbol_table(&st);
-    ParsedLine *plarr = NULL;
-    DataSegment data_seg; init_data_segment(&data_seg);
-    FILE *tmp = NULL;
-    CPUState cpu = {0};
-    int IC = 0, DC = 0;
-
-    if (!read_input(fname, &raw, &raw_n)) goto cleanup;
-    if (!scan_macros((const char**)raw, raw_n, &mt)) goto cleanup;
-    flat = expand_macros((const char**)raw, raw_n, &flat_n, &mt);
-
-    plarr = malloc(sizeof(*plarr) * flat_n);
-    if (!plarr) goto cleanup;
-
-    tmp = tmpfile();
-    if (!tmp) goto cleanup;
-    for (int i = 0; i < flat_n; i++) fputs(flat[i], tmp);
-    fseek(tmp, 0, SEEK_SET);
-
-    if (!first_pass(tmp, &st, &IC, &DC, &data_seg)) {
-        print_error("First pass failed");
-        goto cleanup;
-    }
+/* --format=bin: one .obj instead of .ob/.ent/.ext (set before any assembly) */
+static bool binary_output;
 
-    cpu.memory = calloc(IC, sizeof(uint16_t));
-    cpu.PC = 0;
-    cpu.symtab = &st;
-    if (!cpu.memory) goto cleanup;
-
-    fseek(tmp, 0, SEEK_SET);
-    for (int i = 0; i < flat_n; i++) {
-        parse_line(flat[i], &plarr[i], i);
-    }
-    fclose(tmp); tmp = NULL;
+/* Write the .obj of a finished assembly: entries newest definition first
+ * and external uses in list order, as the text files have them.  False if
+ * it could not be written. */
+static bool write_binary_output(const char *base, const Assembly *as) {
+    int nsyms = symbol_count(&as->symtab), nuses = 0;
+    for (const ExternalUse *u = as->ext_uses; u; u = u->next) nuses++;
+    ObjName *entries = malloc(sizeof(ObjName) * (nsyms + 1));
+    ObjName *externals = malloc(sizeof(ObjName) * (nuses + 1));
+    if (!entries || !externals) error_exit("Memory allocation failed");
 
-    if (!second_pass(plarr, flat_n, &cpu)) {
-        print_error("Second pass failed");
-        goto cleanup;
+    ObjContents c = {
+        .base_address = BASE_ADDRESS,
+        .code = as->code, .code_count = as->code_count,
+        .data = as->data, .data_count = as->data_count,
+        .entries = entries, .externals = externals,
+    };
+    for (int id = nsyms - 1; id >= 0; id--) {
+        const Symbol *sym = symbol_at(&as->symtab, id);
+        if (sym->type == SYM_ENTRY)
+            entries[c.entry_count++] = (ObjName){ sym->name, sym->address };
     }
+    for (const ExternalUse *u = as->ext_uses; u; u = u->next)
+        externals[c.external_count++] = (ObjName){ u->name, u->address };
 
-    const char *base = strip_extension(fname);
-    char *outname;
+    char *outname = strcat_printf(base, ".obj");
+    if (!outname) error_exit("Memory allocation failed");
+    StatMark mark;
+    stats_begin(&mark, 0);
+    bool ok = write_binary_object(outname, &c);
+    stats_end(&mark, PHASE_WRITE_OBJ, 0);
+    free(outname);
+    free(entries);
+    free(externals);
+    return ok;
+}
 
-    if (data_seg.count != DC) {
-        print_error("Data count mismatch");
-    }
+/* Write the .ob/.ent/.ext of a finished assembly next to the source.
+ * False if any of them could not be written. */
+static bool write_outputs(const char *base, const Assembly *as) {
+    if (binary_output)
+        return write_binary_output(base, as);
 
-    outname = strcat_printf(base, ".ob");
-    write_object_file(outname, cpu.memory, IC, data_seg.words, DC, BASE_ADDRESS);
+    StatMark mark;
+    char *outname = strcat_printf(base, ".ob");
+    stats_begin(&mark, 0);
+    bool ok = write_object_file(outname, as->code, as->code_count, as->data, as->data_count,
+                                BASE_ADDRESS);
+    stats_end(&mark, PHASE_WRITE_OB, 0);
     free(outname);
 
     outname = strcat_printf(base, ".ent");
-    if (!write_entries_file(outname, &st))
-        remove(outname);
+    stats_begin(&mark, 0);
+    ok = write_entries_file(outname, &as->symtab) && ok;
+    stats_end(&mark, PHASE_WRITE_ENT, 0);
     free(outname);
 
     outname = strcat_printf(base, ".ext");
-    if (!write_externals_file(outname, cpu.ext_uses))
-        remove(outname);
+    stats_begin(&mark, 0);
+    ok = write_externals_file(outname, as->ext_uses) && ok;
+    stats_end(&mark, PHASE_WRITE_EXT, 0);
     free(outname);
+    return ok;
+}
 
-    ok = true;
-
-cleanup:
-    if (tmp) fclose(tmp);
-    if (cpu.memory) free(cpu.memory);
-    free_data_segment(&data_seg);
-    free_external_uses(cpu.ext_uses);
-    free_symbol_table(&st);
-    /* free all macro definitions */
-    free_macro_table(&mt);
-    if (flat) {
-        for (int i = 0; i < flat_n; i++)
-            free(flat[i]);
-        /* free the resized array of expanded lines */
-        free(flat);
-    }
-    if (raw) { for (int i = 0; i < raw_n; i++) free(raw[i]); free(raw); }
-    if (plarr) {
-        for (int i = 0; i < flat_n; i++) {
-            free(plarr[i].directive_args);
-            free(plarr[i].operands_raw);
+/*
+ * Assemble one file and write its .ob/.ent/.ext next to it, or restore
+ * them from the cache when this exact source was assembled before.
+ * Everything the assembly produces lives in `arena`; `scratch` holds macro
+ * text.  Both arenas are reset, not freed, before returning.
+ */
+static bool assemble_file(const char *fname, Arena *arena, Arena *scratch) {
+    SourceBuffer src;
+    Assembly as;
+    char key[CACHE_KEY_LEN + 1];
+    /* the cache holds text outputs only */
+    bool cached = cache_enabled() && !binary_output;
+    StatMark mark;
+    stats_begin(&mark, 0);
+    if (!load_source(fname, &src)) return false;
+    /* a mapped file is not an allocation; its line index is */
+    stats_end(&mark, PHASE_READ_INPUT, (src.mapped || src.borrowed ? 0 : src.size) +
+                                       sizeof(*src.lines) * src.line_count);
+    char *base = strip_extension(fname);
+    if (!base) { free_source(&src); return false; }
+
+    if (cached) {
+        cache_key(src.data, src.size, key);
+        if (cache_restore(key, base)) {
+            free_source(&src);
+            free(base);
+            return true;
         }
-        free(plarr);
     }
+
+    bool ok = assemble_lines(src.lines, src.line_count, arena, scratch, &as);
+    free_source(&src);
+    if (ok) ok = write_outputs(base, &as);
+    /* only clean runs are cached: a hit prints nothing */
+    if (ok && cached && get_error_count() == 0)
+        cache_store(key, base);
+    free(base);
+
+    /* symbols, parsed lines and the images all go in O(1) */
+    arena_reset(arena);
+    arena_reset(scratch);
     return ok;
 }
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        print_error("Usage: %s <source.as> [source2.as ...]", argv[0]);
-        return 1;
-    }
+static void usage(const char *prog) {
+    print_error("Usage: %s [--stream | --format=text|bin] [-j N] [--manifest FILE]\n"
+                "       [--cache DIR [--cache-size MB] [--cache-stats]]\n"
+                "       [--max-errors N] [--diagnostics=text|json] [--stats] [--trace=FILE]\n"
+                "       <source.as> [source2.as ...]\n"
+                "       %s [-j N] [--format=text|bin] --serve SOCKET", prog, prog);
+}
 
+int main(int argc, char **argv) {
+    bool stream = false;
+    int jobs = 1;
+    const char *serve_sock = NULL;
+    const char *cache_dir = NULL;
+    long long cache_size = CACHE_DEFAULT_LIMIT;
+    bool cache_stats = false;
+    DiagOptions diag = { 0, DIAG_TEXT };
+    bool show_stats = false;
+    const char *trace_path = NULL;
+    char **files = NULL;
+    int nfiles = 0, cap = 0;
     int status = 0;
+
     for (int i = 1; i < argc; i++) {
-        if (!assemble_file(argv[i]))
-            status = 1;
+        if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--format=text") == 0) {
+            binary_output = false;
+        } else if (strcmp(argv[i], "--format=bin") == 0) {
+            binary_output = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            if (!parse_int(argv[++i], 1, INT_MAX, &jobs)) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            char *end;
+            const char *arg = argv[++i];
+            errno = 0;
+            long long mb = strtoll(arg, &end, 10);
+            if (end == arg || *end != '\0' || errno != 0 ||
+                mb < 0 || mb > LLONG_MAX / (1024 * 1024)) {
+                usage(argv[0]);
+                return 1;
+            }
+            cache_size = mb * 1024 * 1024;
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            cache_stats = true;
+        } else if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < argc) {
+            if (!parse_int(argv[++i], 0, INT_MAX, &diag.max_errors)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--diagnostics=text") == 0) {
+            diag.format = DIAG_TEXT;
+        } else if (strcmp(argv[i], "--diagnostics=json") == 0) {
+            diag.format = DIAG_JSON;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = true;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') {
+            trace_path = argv[i] + 8;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_sock = argv[++i];
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            if (!read_manifest(argv[++i], &files, &nfiles, &cap)) {
+                status = 1;
+                goto done;
+            }
+        } else {
+            if (nfiles >= cap) {
+                cap = cap ? cap * 2 : 16;
+                char **tmp = realloc(files, sizeof(char*) * cap);
+                if (!tmp) error_exit("Memory allocation failed");
+                files = tmp;
+            }
+            files[nfiles] = strdup(argv[i]);
+            if (!files[nfiles]) error_exit("Memory allocation failed");
+            nfiles++;
+        }
     }
+    /* the streaming assembler writes its .ob as it goes */
+    if (stream && binary_output) {
+        usage(argv[0]);
+        status = 1;
+        goto done;
+    }
+    if (cache_dir && !cache_configure(cache_dir, cache_size)) {
+        status = 1;
+        goto done;
+    }
+    if (serve_sock) {
+        status = serve(serve_sock, jobs, assemble_file) ? 0 : 1;
+        goto done;
+    }
+    if (nfiles == 0) {
+        usage(argv[0]);
+        status = 1;
+        goto done;
+    }
+
+    /* hand the batch to a warm daemon if one is running; it writes text
+     * outputs and diagnostics with the default settings and its own cache */
+    const char *daemon_sock = getenv("ASSEMBLER_SOCKET");
+    if (daemon_sock && *daemon_sock && !stream && !binary_output && !cache_dir &&
+        !cache_stats && diag.max_errors == 0 && diag.format == DIAG_TEXT &&
+        !show_stats && !trace_path) {
+        status = forward_batch(daemon_sock, files, nfiles);
+        if (status >= 0) goto done;
+        status = 0;
+    }
+
+    Stats stats;
+    stats_init(&stats);
+    if (show_stats || trace_path) stats_enable(trace_path != NULL);
+    if (!assemble_batch(files, nfiles, jobs, stream ? assemble_stream : assemble_file,
+                        &diag, &stats))
+        status = 1;
+    cache_finish(cache_stats ? stderr : NULL);
+    if (show_stats) stats_report(&stats, stderr);
+    if (trace_path && !stats_write_trace(&stats, trace_path)) status = 1;
+    stats_free(&stats);
+
+done:
+    for (int i = 0; i < nfiles; i++)
+        free(files[i]);
+    free(files);
     return status;
 }
-
@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "objfile.h"
+#include "output.h"
+#include "utils.h"
+#include "error.h"
+
+static bool host_little_endian(void) {
+    const uint16_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+/* Store `count` words little-endian at `out` */
+static void put_words(unsigned char *out, const uint16_t *words, int count) {
+    if (host_little_endian()) {
+        memcpy(out, words, (size_t)count * sizeof(uint16_t));
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        out[2*i] = (unsigned char)words[i];
+        out[2*i + 1] = (unsigned char)(words[i] >> 8);
+    }
+}
+
+/* Store a symbol table section and append its names to the string table */
+static void put_symbols(unsigned char *out, const ObjName *syms, int count,
+                        char *strings, size_t *strings_len) {
+    for (int i = 0; i < count; i++, out += sizeof(ObjSymbol)) {
+        size_t len = strlen(syms[i].name) + 1;
+        put32(out, (uint32_t)*strings_len);
+        put32(out + 4, (uint32_t)syms[i].address);
+        memcpy(strings + *strings_len, syms[i].name, len);
+        *strings_len += len;
+    }
+}
+
+bool write_binary_object(const char *filename, const ObjContents *c) {
+    size_t nwords = (size_t)c->code_count + (size_t)c->data_count;
+    size_t strings_size = 0;
+    for (int i = 0; i < c->entry_count; i++)
+        strings_size += strlen(c->entries[i].name) + 1;
+    for (int i = 0; i < c->external_count; i++)
+        strings_size += strlen(c->externals[i].name) + 1;
+
+    size_t words_off = sizeof(ObjHeader);
+    size_t entries_off = align4(words_off + nwords * sizeof(uint16_t));
+    size_t externals_off = entries_off + (size_t)c->entry_count * sizeof(ObjSymbol);
+    size_t strings_off = externals_off + (size_t)c->external_count * sizeof(ObjSymbol);
+    size_t size = strings_off + strings_size;
+    if (size > UINT32_MAX) {
+        print_error("Object too large for %s", filename);
+        return false;
+    }
+    unsigned char *buf = calloc(1, size);
+    if (!buf) error_exit("Memory allocation failed");
+
+    memcpy(buf, OBJ_MAGIC, 4);
+    const uint32_t fields[] = {
+        OBJ_VERSION, (uint32_t)c->base_address,
+        (uint32_t)c->code_count, (uint32_t)c->data_count,
+        (uint32_t)c->entry_count, (uint32_t)c->external_count,
+        (uint32_t)strings_size,
+        (uint32_t)words_off, (uint32_t)entries_off,
+        (uint32_t)externals_off, (uint32_t)strings_off
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+        put32(buf + 4 + 4*i, fields[i]);
+
+    put_words(buf + words_off, c->code, c->code_count);
+    put_words(buf + words_off + (size_t)c->code_count * sizeof(uint16_t),
+              c->data, c->data_count);
+    size_t strings_len = 0;
+    char *strings = (char *)buf + strings_off;
+    put_symbols(buf + entries_off, c->entries, c->entry_count, strings, &strings_len);
+    put_symbols(buf + externals_off, c->externals, c->external_count, strings, &strings_len);
+
+    bool ok = write_whole_file(filename, buf, size, ".obj");
+    free(buf);
+    return ok;
+}
+
+/* True if `count` items of `size` bytes at `off` lie inside the file */
+static bool section_fits(uint32_t off, uint32_t count, size_t size,
+                         size_t file_size, size_t align) {
+    return off % align == 0 && off <= file_size &&
+           (uint64_t)count * size <= file_size - off && count <= INT_MAX;
+}
+
+static bool names_fit(const ObjSymbol *syms, uint32_t count, uint32_t strings_size) {
+    for (uint32_t i = 0; i < count; i++)
+        if (syms[i].name >= strings_size) return false;
+    return true;
+}
+
+bool objfile_load(const char *filename, ObjectImage *img) {
+    memset(img, 0, sizeof(*img));
+    if (!host_little_endian()) {
+        print_error("Binary objects can only be mapped on little-endian hosts");
+        return false;
+    }
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { print_system_error(filename); return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        print_system_error(filename);
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(ObjHeader)) {
+        print_error("Malformed object file: %s", filename);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { print_system_error(filename); return false; }
+
+    const ObjHeader *h = map;
+    const char *base = map;
+    bool ok = memcmp(h->magic, OBJ_MAGIC, 4) == 0 && h->version == OBJ_VERSION &&
+              (uint64_t)h->code_count + h->data_count <= INT_MAX &&
+              section_fits(h->words_offset, h->code_count + h->data_count,
+                           sizeof(uint16_t), size, sizeof(uint16_t)) &&
+              section_fits(h->entries_offset, h->entry_count, sizeof(ObjSymbol),
+                           size, 4) &&
+              section_fits(h->externals_offset, h->external_count, sizeof(ObjSymbol),
+                           size, 4) &&
+              section_fits(h->strings_offset, h->strings_size, 1, size, 1);
+    if (ok && h->strings_size > 0)
+        ok = base[h->strings_offset + h->strings_size - 1] == '\0';
+    if (ok) {
+        img->entries = (const ObjSymbol *)(base + h->entries_offset);
+        img->externals = (const ObjSymbol *)(base + h->externals_offset);
+        ok = names_fit(img->entries, h->entry_count, h->strings_size) &&
+             names_fit(img->externals, h->external_count, h->strings_size);
+    }
+    if (!ok) {
+        print_error("Malformed object file: %s", filename);
+        munmap(map, size);
+        memset(img, 0, sizeof(*img));
+        return false;
+    }
+
+    img->base_address = (int)h->base_address;
+    img->code = (const uint16_t *)(base + h->words_offset);
+    img->code_count = (int)h->code_count;
+    img->data = img->code + h->code_count;
+    img->data_count = (int)h->data_count;
+    img->entry_count = (int)h->entry_count;
+    img->external_count = (int)h->external_count;
+    img->strings = base + h->strings_offset;
+    img->map = map;
+    img->map_size = size;
+    return true;
+}
+
+void objfile_unload(ObjectImage *img) {
+    if (img->map) munmap(img->map, img->map_size);
+    memset(img, 0, sizeof(*img));
+}
+
+/* Value of 8 base-4 digits, or -1 */
+static long parse_base4(const char *s) {
+    long v = 0;
+    int i;
+    for (i = 0; i < 8 && s[i] >= '0' && s[i] <= '3'; i++)
+        v = v << 2 | (s[i] - '0');
+    return i == 8 && s[8] == '\0' ? v : -1;
+}
+
+/* Name/address lines of a .ent or .ext; a missing file has none */
+static bool read_symbol_file(const char *filename, ObjName **out, int *count) {
+    *out = NULL;
+    *count = 0;
+    FILE *f = fopen(filename, "r");
+    if (!f) return true;
+
+    int cap = 0;
+    char name[32], addr[16];
+    bool ok = true;
+    int n;
+    while ((n = fscanf(f, "%31s %15s", name, addr)) == 2) {
+        long a = parse_base4(addr);
+        if (a < 0) { ok = false; break; }
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 16;
+            ObjName *tmp = realloc(*out, sizeof(**out) * cap);
+            if (!tmp) error_exit("Memory allocation failed");
+            *out = tmp;
+        }
+        char *copy = strdup(name);
+        if (!copy) error_exit("Memory allocation failed");
+        (*out)[*count].name = copy;
+        (*out)[(*count)++].address = (int)a;
+    }
+    if (n != EOF) ok = false;
+    fclose(f);
+    if (!ok) print_error("Malformed symbol file: %s", filename);
+    return ok;
+}
+
+static void free_names(ObjName *names, int count) {
+    for (int i = 0; i < count; i++)
+        free((char *)names[i].name);
+    free(names);
+}
+
+bool objfile_from_text(const char *base) {
+    char *obname = strcat_printf(base, ".ob");
+    char *entname = strcat_printf(base, ".ent");
+    char *extname = strcat_printf(base, ".ext");
+    char *outname = strcat_printf(base, ".obj");
+    if (!obname || !entname || !extname || !outname)
+        error_exit("Memory allocation failed");
+
+    ObjContents c;
+    memset(&c, 0, sizeof(c));
+    c.base_address = BASE_ADDRESS;
+    ObjName *entries = NULL, *externals = NULL;
+    uint16_t *words = NULL;
+    bool ok = false;
+
+    FILE *f = fopen(obname, "r");
+    if (!f) { print_system_error(obname); goto done; }
+    int ic, dc;
+    if (fscanf(f, "%d %d", &ic, &dc) != 2 || ic < 0 || dc < 0 || ic > INT_MAX - dc) {
+        print_error("Malformed object file: %s", obname);
+        fclose(f);
+        goto done;
+    }
+    words = malloc(((size_t)ic + dc) * sizeof(uint16_t) + 1);
+    if (!words) error_exit("Memory allocation failed");
+    ok = true;
+    for (int i = 0; ok && i < ic + dc; i++) {
+        char addr[16], word[16];
+        long a = -1, w = -1;
+        if (fscanf(f, "%15s %15s", addr, word) == 2) {
+            a = parse_base4(addr);
+            w = parse_base4(word);
+        }
+        if (i == 0 && a >= 0) c.base_address = (int)a;
+        if (a < 0 || w < 0 || a != ((c.base_address + i) & 0xFFFF)) ok = false;
+        else words[i] = (uint16_t)w;
+    }
+    fclose(f);
+    if (!ok) { print_error("Malformed object file: %s", obname); goto done; }
+
+    c.code = words;
+    c.code_count = ic;
+    c.data = words + ic;
+    c.data_count = dc;
+    ok = read_symbol_file(entname, &entries, &c.entry_count) &&
+         read_symbol_file(extname, &externals, &c.external_count);
+    c.entries = entries;
+    c.externals = externals;
+    if (ok) ok = write_binary_object(outname, &c);
+
+done:
+    free_names(entries, c.entry_count);
+    free_names(externals, c.external_count);
+    free(words);
+    free(obname);
+    free(entname);
+    free(extname);
+    free(outname);
+    return ok;
+}
+
+/* Write one symbol section as a .ent/.ext, or remove the file if it has none */
+static bool write_symbol_file(const char *filename, const ObjectImage *img,
+                              const ObjSymbol *syms, int count) {
+    if (count == 0) {
+        remove(filename);
+        return true;
+    }
+    FILE *f = fopen(filename, "w");
+    if (!f) { print_system_error(filename); return false; }
+    for (int i = 0; i < count; i++)
+        write_symbol_line(f, obj_symbol_name(img, &syms[i]), (int)syms[i].address);
+    return fclose(f) == 0;
+}
+
+bool objfile_to_text(const char *base) {
+    char *inname = strcat_printf(base, ".obj");
+    char *obname = strcat_printf(base, ".ob");
+    char *entname = strcat_printf(base, ".ent");
+    char *extname = strcat_printf(base, ".ext");
+    if (!inname || !obname || !entname || !extname)
+        error_exit("Memory allocation failed");
+
+    ObjectImage img;
+    bool ok = objfile_load(inname, &img);
+    if (ok) {
+        ok = write_object_file(obname, img.code, img.code_count, img.data,
+                               img.data_count, img.base_address) &&
+             write_symbol_file(entname, &img, img.entries, img.entry_count) &&
+             write_symbol_file(extname, &img, img.externals, img.external_count);
+        objfile_unload(&img);
+    }
+    free(inname);
+    free(obname);
+    free(entname);
+    free(extname);
+    return ok;
+}
@@ -0,0 +1,99 @@
+#ifndef OBJFILE_H
+#define OBJFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Binary object files (.obj): the program of a .ob/.ent/.ext triple,
+ * laid out so a loader can map the file and use it in place.
+ *
+ *     ObjHeader
+ *     uint16_t  words[code_count + data_count]    code first, then data
+ *     ObjSymbol entries[entry_count]              in .ent order
+ *     ObjSymbol externals[external_count]         in .ext order
+ *     char      strings[strings_size]             NUL-terminated names
+ *
+ * Every section starts at a multiple of 4 bytes and every field is
+ * little-endian.
+ */
+
+#define OBJ_MAGIC   "CAOB"
+#define OBJ_VERSION 1
+
+typedef struct {
+    char     magic[4];           /* OBJ_MAGIC, no NUL */
+    uint32_t version;
+    uint32_t base_address;       /* address of words[0] */
+    uint32_t code_count;
+    uint32_t data_count;
+    uint32_t entry_count;
+    uint32_t external_count;
+    uint32_t strings_size;
+    uint32_t words_offset;       /* byte offsets from the start of the file */
+    uint32_t entries_offset;
+    uint32_t externals_offset;
+    uint32_t strings_offset;
+} ObjHeader;
+
+/* A symbol, or a use of an external symbol */
+typedef struct {
+    uint32_t name;               /* offset of the name in the string table */
+    uint32_t address;
+} ObjSymbol;
+
+/* A name and address, as the writer takes them */
+typedef struct {
+    const char *name;
+    int         address;
+} ObjName;
+
+/* What goes into an object file */
+typedef struct {
+    int             base_address;
+    const uint16_t *code;
+    int             code_count;
+    const uint16_t *data;
+    int             data_count;
+    const ObjName  *entries;
+    int             entry_count;
+    const ObjName  *externals;
+    int             external_count;
+} ObjContents;
+
+/* A loaded object file.  Every pointer points into the mapping and stays
+ * valid until objfile_unload(). */
+typedef struct {
+    int              base_address;
+    const uint16_t  *code;
+    int              code_count;
+    const uint16_t  *data;
+    int              data_count;
+    const ObjSymbol *entries;
+    int              entry_count;
+    const ObjSymbol *externals;
+    int              external_count;
+    const char      *strings;
+    void            *map;
+    size_t           map_size;
+} ObjectImage;
+
+static inline const char *obj_symbol_name(const ObjectImage *img, const ObjSymbol *sym) {
+    return img->strings + sym->name;
+}
+
+/* Write `c` to `filename` in one go */
+bool write_binary_object(const char *filename, const ObjContents *c);
+
+/* Map `filename` and check that every section and name lies inside it.
+ * Nothing is copied or converted, so this needs a little-endian host. */
+bool objfile_load(const char *filename, ObjectImage *img);
+void objfile_unload(ObjectImage *img);
+
+/* Converters between the formats: `base`.ob and its .ent/.ext (when
+ * present) to `base`.obj, and back */
+bool objfile_from_text(const char *base);
+bool objfile_to_text(const char *base);
+
+#endif /* OBJFILE_H */
@@ -1,8 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "output.h"
+#include "error.h"
 #include "utils.h"  // ל-format של שורות, convert_to_base4 וכד'
 
+/* Base-4 digits of every byte value */
+#define B4(n)    { '0' + ((n) >> 6 & 3), '0' + ((n) >> 4 & 3), \
+                   '0' + ((n) >> 2 & 3), '0' + ((n) & 3) }
+#define B4_4(n)  B4(n), B4((n) + 1), B4((n) + 2), B4((n) + 3)
+#define B4_16(n) B4_4(n), B4_4((n) + 4), B4_4((n) + 8), B4_4((n) + 12)
+#define B4_64(n) B4_16(n), B4_16((n) + 16), B4_16((n) + 32), B4_16((n) + 48)
+static const char base4_digits[256][4] = {
+    B4_64(0), B4_64(64), B4_64(128), B4_64(192)
+};
+
+/* The 8 base-4 digits of a word, not NUL-terminated */
+static inline void put_base4(char *out, uint16_t value)
+{
+    memcpy(out, base4_digits[value >> 8], 4);
+    memcpy(out + 4, base4_digits[value & 0xff], 4);
+}
+
+/* Format `count` words whose first one is at `address` as .ob lines */
+static void format_words(char *out, const uint16_t *words, int count, int address)
+{
+    for (int i = 0; i < count; i++, out += OB_LINE) {
+        put_base4(out, (uint16_t)(address + i));
+        out[8] = ' ';
+        put_base4(out + 9, words[i]);
+        out[17] = '\n';
+    }
+}
+
+bool object_writer_open(ObjectWriter *w,
+                        const char *filename,
+                        int instruction_count,
+                        int data_count,
+                        int base_address)
+{
+    w->f = fopen(filename, "w");
+    w->address = base_address;
+    w->failed = false;
+    w->len = 0;
+    if (!w->f) { print_system_error("open .ob"); return false; }
+
+    // שורה ראשונה: מספר הוראות ומספר מילים בקובץ נתונים
+    fprintf(w->f, "%d %d\n", instruction_count, data_count);
+    return true;
+}
+
+void object_writer_put(ObjectWriter *w, uint16_t word)
+{
+    if (w->len == sizeof(w->buf)) {
+        if (fwrite(w->buf, 1, w->len, w->f) != w->len)
+            w->failed = true;
+        w->len = 0;
+    }
+    format_words(w->buf + w->len, &word, 1, w->address++);
+    w->len += OB_LINE;
+}
+
+bool object_writer_close(ObjectWriter *w)
+{
+    bool ok = !w->failed && fwrite(w->buf, 1, w->len, w->f) == w->len;
+    ok = fclose(w->f) == 0 && ok;
+    w->f = NULL;
+    if (!ok) print_system_error("write .ob");
+    return ok;
+}
+
+/* Images of at least this many words per thread are formatted by several
+ * threads (see split_count) */
+#define OB_PARALLEL_WORDS (1 << 18)
+#define OB_MAX_THREADS    8
+
+/* A run of words to format, and where its lines go */
+typedef struct {
+    char           *out;
+    const uint16_t *words;
+    int             count;
+    int             address;
+} FormatJob;
+
+/* Format jobs[t] (a run_split piece) */
+static void format_job(void *jobs, int t)
+{
+    FormatJob *job = (FormatJob *)jobs + t;
+    format_words(job->out, job->words, job->count, job->address);
+}
+
+/* Format the lines of `count` words, in `nthreads` pieces when it pays */
+static void format_image(char *out, const uint16_t *words, int count, int address)
+{
+    int nthreads = split_count(count, OB_PARALLEL_WORDS, OB_MAX_THREADS);
+    if (nthreads < 2) {
+        format_words(out, words, count, address);
+        return;
+    }
+
+    FormatJob jobs[OB_MAX_THREADS];
+    int per = count / nthreads;
+    for (int t = 0; t < nthreads; t++) {
+        int first = t * per;
+        jobs[t].out = out + (size_t)first * OB_LINE;
+        jobs[t].words = words + first;
+        jobs[t].count = t == nthreads - 1 ? count - first : per;
+        jobs[t].address = address + first;
+    }
+    run_split(nthreads, format_job, jobs);
+}
+
+bool write_whole_file(const char *filename, const void *buf, size_t size,
+                      const char *kind)
+{
+    char what[32];
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        snprintf(what, sizeof(what), "open %s", kind);
+        print_system_error(what);
+        return false;
+    }
+    bool ok = true;
+    for (size_t done = 0; done < size; ) {
+        ssize_t n = write(fd, (const char *)buf + done, size - done);
+        if (n < 0) {
+            snprintf(what, sizeof(what), "write %s", kind);
+            print_system_error(what);
+            ok = false;
+            break;
+        }
+        done += (size_t)n;
+    }
+    if (close(fd) != 0 && ok) {
+        snprintf(what, sizeof(what), "write %s", kind);
+        print_system_error(what);
+        ok = false;
+    }
+    return ok;
+}
+
 bool write_object_file(const char *filename,
                        const uint16_t *instructions,
                        int instruction_count,
@@ -10,71 +150,88 @@ bool write_object_file(const char *filename,
                        int data_count,
                        int base_address)
 {
-    FILE *f = fopen(filename, "w");
-    if (!f) { perror("open .ob"); return false; }
+    /* every line has a fixed width, so the whole file is formatted into one
+     * buffer of its exact size and written at once */
+    char header[32];
+    int header_len = snprintf(header, sizeof(header), "%d %d\n",
+                              instruction_count, data_count);
+    size_t size = (size_t)header_len +
+                  ((size_t)instruction_count + (size_t)data_count) * OB_LINE;
+    char *buf = malloc(size);
+    if (!buf) error_exit("Memory allocation failed");
 
-    // שורה ראשונה: מספר הוראות ומספר מילים בקובץ נתונים
-    fprintf(f, "%d %d\n", instruction_count, data_count);
-
-    // הוראות מקודדות עם כתובות
-    int address = base_address;
-    for (int i = 0; i < instruction_count; i++, address++) {
-        char addr_buf[32], word_buf[32];
-        convert_to_base4((uint16_t)address, addr_buf);
-        convert_to_base4(instructions[i], word_buf);
-        fprintf(f, "%s %s\n", addr_buf, word_buf);
-    }
-    // ואחריהן קטע הנתונים
-    for (int i = 0; i < data_count; i++, address++) {
-        char addr_buf[32], word_buf[32];
-        convert_to_base4((uint16_t)address, addr_buf);
-        convert_to_base4(data[i], word_buf);
-        fprintf(f, "%s %s\n", addr_buf, word_buf);
+    memcpy(buf, header, (size_t)header_len);
+    char *code = buf + header_len;
+    // הוראות מקודדות עם כתובות, ואחריהן קטע הנתונים
+    format_image(code, instructions, instruction_count, base_address);
+    format_image(code + (size_t)instruction_count * OB_LINE, data, data_count,
+                 base_address + instruction_count);
+
+    bool ok = write_whole_file(filename, buf, size, ".ob");
+    free(buf);
+    return ok;
+}
+
+void write_symbol_line(FILE *f, const char *name, int address)
+{
+    char tail[10];
+    tail[0] = ' ';
+    put_base4(tail + 1, (uint16_t)address);
+    tail[9] = '\n';
+    fputs(name, f);
+    fwrite(tail, 1, sizeof(tail), f);
+}
+
+/* Close a .ent/.ext; false (reported) if anything written to it was lost */
+static bool close_symbol_file(FILE *f, const char *kind)
+{
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        char what[32];
+        snprintf(what, sizeof(what), "write %s", kind);
+        print_system_error(what);
     }
-    fclose(f);
-    return true;
+    return ok;
 }
 
 bool write_entries_file(const char *filename,
-                        const Symbol *symtab)
+                        const SymbolTable *symtab)
 {
-    /* first scan to see if there are any entry symbols */
-    const Symbol *s = symtab;
-    while (s && s->type != SYM_ENTRY)
-        s = s->next;
-    if (!s)
-        return false; /* no entries: don't create the file */
+    /* entries are listed newest definition first */
+    int id = symbol_count(symtab) - 1;
+    while (id >= 0 && symbol_at(symtab, id)->type != SYM_ENTRY)
+        id--;
+    if (id < 0) {
+        remove(filename); /* no entries: no file */
+        return true;
+    }
 
     FILE *f = fopen(filename, "w");
-    if (!f) { perror("open .ent"); return false; }
-
-    /* s already points to the first entry symbol */
-    for (; s; s = s->next) {
-        if (s->type == SYM_ENTRY) {
-            char buf[32];
-            convert_to_base4(s->address, buf);
-            fprintf(f, "%s %s\n", s->name, buf);
-        }
+    if (!f) { print_system_error("open .ent"); return false; }
+
+    /* id already points to the first entry symbol */
+    for (; id >= 0; id--) {
+        const Symbol *s = symbol_at(symtab, id);
+        if (s->type == SYM_ENTRY)
+            write_symbol_line(f, s->name, s->address);
     }
-    fclose(f);
-    return true;
+    return close_symbol_file(f, ".ent");
 }
 
 bool write_externals_file(const char *filename,
                           const ExternalUse *uses)
 {
-    /* If there are no recorded external usages, nothing to do */
-    if (!uses)
-        return false;
+    /* no recorded external usages: no file */
+    if (!uses) {
+        remove(filename);
+        return true;
+    }
 
     FILE *f = fopen(filename, "w");
-    if (!f) { perror("open .ext"); return false; }
-    for (const ExternalUse *u = uses; u; u = u->next) {
-        char buf[32];
-        convert_to_base4(u->address, buf);
-        fprintf(f, "%s %s\n", u->name, buf);
-    }
-    fclose(f);
-    return true;
+    if (!f) { print_system_error("open .ext"); return false; }
+    for (const ExternalUse *u = uses; u; u = u->next)
+        write_symbol_line(f, u->name, u->address);
+    return close_symbol_file(f, ".ext");
 }
 
@@ -1,9 +1,38 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include "symbol_table.h"
 
+/* Bytes of every .ob line after the header: "<address> <word>\n" */
+#define OB_LINE 18
+
+/* Incremental .ob writer: the header up front, then one word per call.
+ * Lines are formatted into `buf` and written a buffer at a time. */
+typedef struct {
+    FILE  *f;
+    int    address;   /* address of the next word */
+    bool   failed;    /* a write fell short; reported by object_writer_close */
+    size_t len;       /* bytes of buf in use */
+    char   buf[OB_LINE * 1024];
+} ObjectWriter;
+
+bool object_writer_open(ObjectWriter *w,
+                        const char *filename,
+                        int instruction_count,
+                        int data_count,
+                        int base_address);
+void object_writer_put(ObjectWriter *w, uint16_t word);
+/* Flush and close; false (reported) if any write or the close failed */
+bool object_writer_close(ObjectWriter *w);
+
+/* Create or replace `filename` with `size` bytes from `buf`, written in
+ * as few syscalls as the kernel allows.  `kind` (".ob") names the file in
+ * error messages. */
+bool write_whole_file(const char *filename, const void *buf, size_t size,
+                      const char *kind);
+
 /* Generates the object file (.ob) from memory image */
 bool write_object_file(const char *filename,
                        const uint16_t *instructions,
@@ -13,18 +42,22 @@ bool write_object_file(const char *filename,
                        int base_address);
 
 /*
- * Write all symbols marked as .entry to a .ent file. Returns true only if the
- * file was created (i.e., at least one entry symbol exists).
+ * Write all symbols marked as .entry to a .ent file, or remove the file if
+ * there are none. Returns false (reported) if it could not be written.
  */
 bool write_entries_file(const char *filename,
-                        const Symbol *symtab);
+                        const SymbolTable *symtab);
 
 /*
- * Write all recorded uses of external symbols to a .ext file. Returns true
- * only if the file was created (i.e., at least one external use exists).
+ * Write all recorded uses of external symbols to a .ext file, or remove the
+ * file if there are none. Returns false (reported) if it could not be
+ * written.
  */
 bool write_externals_file(const char *filename,
                           const ExternalUse *uses);
 
+/* Write one "<name> <base-4 address>" line as used by .ent and .ext */
+void write_symbol_line(FILE *f, const char *name, int address);
+
 #endif /* OUTPUT_H */
 
@@ -2,138 +2,121 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <ctype.h>
 
 #include "parser.h"
+#include "keywords.h"
+#include "lexer.h"
 
-/* trim in-place, remove comments after ';' */
-static void normalize(char *s) {
-    /* strip comment */
-    char *c = strchr(s, ';');
-    if (c) *c = '\0';
-    trim_string(s);            /* leading/trailing spaces, from utils */
+/* Copy [off, end) of `src`, without surrounding whitespace, into `arena` */
+static char *copy_trimmed(Arena *arena, const char *src, int off, int end) {
+    off = lex_skip_space(src, off, end);
+    while (end > off && is_space_char(src[end - 1])) end--;
+    char *s = arena_strndup(arena, src + off, (size_t)(end - off));
+    if (!s) error_exit("Memory allocation failed");
+    return s;
 }
 
-/* Identify empty/comment/directive/instruction/label-only */
-static StatementType identify_statement_type(const char *s) {
-    if (*s == '\0')        return STMT_EMPTY;
-    if (*s == ';')         return STMT_COMMENT;
-    if (*s == '.')         return STMT_DIRECTIVE;
-    if (strchr(s, ':'))    return STMT_LABEL_ONLY;
-    /* else assume mnemonic */
-    return STMT_INSTRUCTION;
-}
-
-/* Map directive token -> enum */
-static DirectiveType directive_from_token(const char *tok) {
-    if (strcasecmp(tok, "data")   == 0) return DIR_DATA;
-    if (strcasecmp(tok, "string") == 0) return DIR_STRING;
-    if (strcasecmp(tok, "mat")    == 0) return DIR_MAT;
-    if (strcasecmp(tok, "entry")  == 0) return DIR_ENTRY;
-    if (strcasecmp(tok, "extern") == 0) return DIR_EXTERN;
-    return DIR_INVALID;
-}
-
-/* Parse one line into ParsedLine */
-bool parse_line(const char *src, ParsedLine *out, int line_no) {
-    char *buf = strdup(src);
-    if (!buf) error_exit("Memory allocation failed");
-    normalize(buf);
-
+/*
+ * Parse one line into ParsedLine, straight from the source bytes.  One pass
+ * of the lexer finds where the statement starts and ends (comments
+ * excluded) and its colons; the label, opcode and directive name are then
+ * read at known offsets, and only the operand text is copied.
+ */
+bool parse_line(const char *src, int len, ParsedLine *out, int line_no, Arena *arena) {
     memset(out, 0, sizeof(*out));
     out->line_number = line_no;
-    out->directive_args = NULL;
-    out->operands_raw = NULL;
 
-    StatementType st = identify_statement_type(buf);
-    out->type = st;
-    if (st==STMT_EMPTY || st==STMT_COMMENT) { free(buf); return true; }
+    Lexer lx;
+    Token tok;
+    lex_init(&lx, src, len);
+    if (!lex_next(&lx, &tok)) {
+        out->type = STMT_EMPTY;
+        return true;
+    }
+    int start = tok.off;          /* first byte of the statement */
+    int end = tok.off + tok.len;  /* one past its last byte */
+    int colon = -1, colons = 0;
+    do {
+        if (tok.kind == TOK_COLON) {
+            if (colon < 0) colon = tok.off;
+            colons++;
+        }
+        end = tok.off + tok.len;
+    } while (lex_next(&lx, &tok));
 
-    char *p = buf;
+    int p = start;
+    out->type = src[p] == '.' ? STMT_DIRECTIVE :
+                colon >= 0    ? STMT_LABEL_ONLY : STMT_INSTRUCTION;
 
     /* LABEL: handling */
-    if (st==STMT_LABEL_ONLY || strchr(p, ':')) {
-        char *col = strchr(p, ':');
-        size_t len = col - p;
-        if (len >= MAX_LABEL_LEN) {
+    if (colon >= 0) {
+        int label_len = colon - start;
+        if (label_len >= MAX_LABEL_LEN) {
             print_error("Line too long label");
-            free(buf);
             return false;
         }
-        strncpy(out->label, p, len);
-        out->label[len] = '\0';
+        memcpy(out->label, src + start, (size_t)label_len);
+        out->label[label_len] = '\0';
         if (!is_valid_label(out->label)) {
             if (is_reserved_word(out->label))
                 print_error("Label cannot be a reserved word");
             else
                 print_error("Invalid label name");
-            free(buf);
             return false;
         }
         out->has_label = true;
-        p = col+1;
-        trim_string(p);
-        if (*p=='\0') {
+        p = lex_skip_space(src, colon + 1, end);
+        if (p == end) {
             out->type = STMT_LABEL_ONLY;
-            free(buf);
             return true;
         }
         /* recalc kind */
-        st = identify_statement_type(p);
-        out->type = st;
+        out->type = src[p] == '.' ? STMT_DIRECTIVE :
+                    colons > 1    ? STMT_LABEL_ONLY : STMT_INSTRUCTION;
     }
 
-    /* Directive */
+    /* Directive: ".name" (the name may follow the dot after blanks) */
     if (out->type==STMT_DIRECTIVE) {
-        /* read ".token" */
-        if (p[0]!='.') {
-            print_error("Directive missing dot");
-            free(buf);
-            return false;
-        }
-        char tok[MAX_OPCODE_LEN];
-        if (sscanf(p+1, "%9s", tok)!=1) {
+        int name = lex_skip_space(src, p + 1, end);
+        if (name == end) {
             print_error("Malformed directive");
-            free(buf);
             return false;
         }
-        DirectiveType dt = directive_from_token(tok);
-        if (dt==DIR_INVALID) {
+        int name_len = lex_word_len(src, name, end, MAX_OPCODE_LEN - 1);
+        Keyword kw = keyword_lookup(src + name, (size_t)name_len);
+        if (kw.kind != KW_DIRECTIVE) {
             print_error("Unknown directive");
-            free(buf);
             return false;
         }
-        out->dir_type = dt;
-        /* skip ".tok" + whitespace */
-        p = p+1+strlen(tok);
-        trim_string(p);
-        out->directive_args = strdup(p);
-        if (!out->directive_args) error_exit("Memory allocation failed");
-        free(buf);
+        out->dir_type = (DirectiveType)kw.value;
+        out->directive_args = copy_trimmed(arena, src, name + name_len, end);
         return true;
     }
 
-    /* Instruction */
+    /* Instruction: the opcode is the first MAX_OPCODE_LEN-1 non-blank bytes */
     if (out->type==STMT_INSTRUCTION) {
-        /* read opcode */
-        char opc[MAX_OPCODE_LEN];
-        if (sscanf(p, "%9s", opc)!=1) {
-            print_error("Missing opcode");
-            free(buf);
-            return false;
-        }
-        strncpy(out->opcode, opc, MAX_OPCODE_LEN-1);
-        /* skip it */
-        p += strlen(opc);
-        trim_string(p);
-        out->operands_raw = strdup(p);
-        if (!out->operands_raw) error_exit("Memory allocation failed");
-        free(buf);
+        int opc_len = lex_word_len(src, p, end, MAX_OPCODE_LEN - 1);
+        memcpy(out->opcode, src + p, (size_t)opc_len);
+        out->operands_raw = copy_trimmed(arena, src, p + opc_len, end);
         return true;
     }
 
     print_error("Unhandled line");
-    free(buf);
     return false;
 }
+
+bool parse_line_view(const LineView *line, ParsedLine *out, Arena *arena) {
+    if (!line->parsed)
+        return parse_line(line->ptr, line->len, out, line->line_no, arena);
+    *out = *line->parsed;
+    out->line_number = line->line_no;
+    if (out->directive_args) {
+        out->directive_args = arena_strdup(arena, out->directive_args);
+        if (!out->directive_args) error_exit("Memory allocation failed");
+    }
+    if (out->operands_raw) {
+        out->operands_raw = arena_strdup(arena, out->operands_raw);
+        if (!out->operands_raw) error_exit("Memory allocation failed");
+    }
+    return true;
+}
@@ -3,11 +3,13 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "utils.h"          /* trim_string, is_valid_label, is_reserved_word */
 #include "symbol_table.h"   /* add_label, add_label_external, relocate_data_symbols */
 #include "error.h"          /* get_error_count */
 #include "data_segment.h"  /* DataSegment */
+#include "source.h"        /* LineView */
 
 #define MAX_LABEL_LEN     32
 #define MAX_OPCODE_LEN    10
@@ -31,8 +33,36 @@ typedef enum {
     DIR_INVALID
 } DirectiveType;
 
-/* Parsed info for one line of source */
+/* Longest encoding: opcode word plus two matrix operands of two words each */
+#define MAX_INSTRUCTION_WORDS 5
+
+/* Addressing modes, as encoded in the first word of an instruction */
+enum { AM_IMMEDIATE = 0, AM_DIRECT = 1, AM_REGISTER = 2, AM_MATRIX = 3,
+       AM_NONE = 4 /* operand left out: encoded as 0 */ };
+
+/* One decoded operand.  A direct or matrix operand names a symbol; its
+ * address goes into word `at` of the instruction in the second pass. */
+typedef struct {
+    unsigned char mode;      /* AM_* */
+    unsigned char reg;       /* register, or the row register of a matrix */
+    unsigned char reg2;      /* column register of a matrix */
+    unsigned char at;        /* index of the label address word, 0 if none */
+    int16_t       value;     /* immediate */
+    const char   *label;     /* allocated from the assembly's arena */
+} Operand;
+
+/* An instruction as the first pass decodes it: every word except the
+ * label addresses, which only the complete symbol table can supply */
 typedef struct {
+    signed char   opcode;    /* 0..15, or -1 for an unknown mnemonic */
+    unsigned char size;      /* words the first pass counts (see decode_instruction) */
+    unsigned char count;     /* words the second pass emits */
+    Operand       src, dst;
+    uint16_t      words[MAX_INSTRUCTION_WORDS];
+} Instruction;
+
+/* Parsed info for one line of source */
+typedef struct ParsedLine {
     StatementType type;
     int           line_number;
 
@@ -41,20 +71,42 @@ typedef struct {
 
     /* directive-specific */
     DirectiveType dir_type;
-    char         *directive_args;    /* dynamically allocated */
+    char         *directive_args;    /* allocated from the assembly's arena */
 
     /* instruction-specific */
     char          opcode[MAX_OPCODE_LEN];
-    char         *operands_raw;      /* dynamically allocated */
+    char         *operands_raw;      /* allocated from the assembly's arena */
+    Instruction   ins;               /* filled in by the first pass */
 } ParsedLine;
 
 /* Public API */
-bool  parse_line(const char *src, ParsedLine *out, int line_no);
-bool  first_pass(FILE *src,
+/* Parse `len` bytes at `src` (no NUL terminator needed); the argument
+ * strings of the result are allocated from `arena` */
+bool  parse_line(const char *src, int len, ParsedLine *out, int line_no, Arena *arena);
+/* Parse a line view; a statement macro expansion already parsed is copied
+ * instead, with its argument string moved into `arena` */
+bool  parse_line_view(const LineView *line, ParsedLine *out, Arena *arena);
+/* Parse `lines` into `parsed` (line_count entries) and run the first pass */
+bool  first_pass(const LineView *lines,
+                 int line_count,
+                 ParsedLine *parsed,
+                 Arena *arena,
                  SymbolTable *symtab,
                  int *IC_out,
                  int *DC_out,
                  DataSegment *data_seg);
 
+/* Building blocks of first_pass(), also used by the streaming assembler:
+ * process one statement (decoding an instruction into pl->ins, with its
+ * labels allocated from `arena`), then relocate symbols once every line
+ * was seen. */
+void  first_pass_statement(ParsedLine *pl,
+                           Arena *arena,
+                           SymbolTable *symtab,
+                           int *IC_io,
+                           int *DC_io,
+                           DataSegment *data_seg);
+void  first_pass_finish(SymbolTable *symtab, int IC);
+
 #endif /* PARSER_H */
 
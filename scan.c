@@ -0,0 +1,128 @@
+#include <string.h>
+
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* Scan classes of every byte, for the scalar kernel */
+static const unsigned short byte_class[256] = {
+    ['\n'] = SCAN_NEWLINE | SCAN_SPACE,
+    [' ']  = SCAN_SPACE, ['\t'] = SCAN_SPACE, ['\v'] = SCAN_SPACE,
+    ['\f'] = SCAN_SPACE, ['\r'] = SCAN_SPACE,
+    [';']  = SCAN_SEMI,  [',']  = SCAN_COMMA, [':'] = SCAN_COLON,
+    ['"']  = SCAN_QUOTE, ['[']  = SCAN_LBRACKET, [']'] = SCAN_RBRACKET,
+    ['\0'] = SCAN_NUL,
+};
+
+static uint32_t scan_block_scalar(const char *p, unsigned set) {
+    uint32_t mask = 0;
+    for (int i = 0; i < SCAN_BLOCK; i++)
+        if (byte_class[(unsigned char)p[i]] & set)
+            mask |= (uint32_t)1 << i;
+    return mask;
+}
+
+#ifdef SCAN_X86
+
+/* SSE2: 16 bytes per compare; one block is two halves */
+__attribute__((target("sse2")))
+static uint32_t scan_half_sse2(const char *p, unsigned set) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_setzero_si128();
+    if (set & SCAN_NEWLINE)  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    if (set & SCAN_SEMI)     m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    if (set & SCAN_COMMA)    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+    if (set & SCAN_COLON)    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+    if (set & SCAN_QUOTE)    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    if (set & SCAN_LBRACKET) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+    if (set & SCAN_RBRACKET) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+    if (set & SCAN_NUL)      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    if (set & SCAN_SPACE) {
+        /* \t..\r are 9..13: (c - 9) < 5 unsigned, as a signed compare on c - 9 - 128 */
+        __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(9 + (char)-128));
+        __m128i ctl = _mm_cmplt_epi8(t, _mm_set1_epi8((char)(-128 + 5)));
+        m = _mm_or_si128(m, _mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))));
+    }
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("sse2")))
+static uint32_t scan_block_sse2(const char *p, unsigned set) {
+    return scan_half_sse2(p, set) | scan_half_sse2(p + 16, set) << 16;
+}
+
+__attribute__((target("avx2")))
+static uint32_t scan_block_avx2(const char *p, unsigned set) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_setzero_si256();
+    if (set & SCAN_NEWLINE)  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    if (set & SCAN_SEMI)     m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    if (set & SCAN_COMMA)    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+    if (set & SCAN_COLON)    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')));
+    if (set & SCAN_QUOTE)    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    if (set & SCAN_LBRACKET) m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')));
+    if (set & SCAN_RBRACKET) m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')));
+    if (set & SCAN_NUL)      m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    if (set & SCAN_SPACE) {
+        __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(9 + (char)-128));
+        __m256i ctl = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 5)), t);
+        m = _mm256_or_si256(m, _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '))));
+    }
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+#endif /* SCAN_X86 */
+
+typedef uint32_t (*ScanBlockFn)(const char *p, unsigned set);
+
+/* The scalar kernel is always correct; a faster one replaces it at load */
+static ScanBlockFn scan_impl = scan_block_scalar;
+static const char *scan_name = "scalar";
+
+bool scan_set_kernel(const char *name) {
+    if (strcmp(name, "scalar") == 0) {
+        scan_impl = scan_block_scalar;
+        scan_name = "scalar";
+        return true;
+    }
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        scan_impl = scan_block_sse2;
+        scan_name = "sse2";
+        return true;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        scan_impl = scan_block_avx2;
+        scan_name = "avx2";
+        return true;
+    }
+#endif
+    return false;
+}
+
+#ifdef SCAN_X86
+__attribute__((constructor))
+static void scan_select(void) {
+    if (!scan_set_kernel("avx2"))
+        scan_set_kernel("sse2");
+}
+#endif
+
+uint32_t scan_block(const char *p, unsigned set) {
+    return scan_impl(p, set);
+}
+
+uint32_t scan_tail(const char *p, int n, unsigned set) {
+    /* a zeroed copy keeps the vector load inside our own buffer */
+    char buf[SCAN_BLOCK] = {0};
+    memcpy(buf, p, (size_t)n);
+    return scan_impl(buf, set) & (((uint32_t)1 << n) - 1);
+}
+
+const char *scan_kernel(void) {
+    return scan_name;
+}
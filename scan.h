@@ -0,0 +1,55 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Vectorised byte classification.  scan_block() looks at SCAN_BLOCK bytes
+ * at once and returns a bitmask with bit i set when byte i belongs to one
+ * of the requested classes.  The kernel is chosen once at startup: AVX2 or
+ * SSE2 on x86 when the CPU has them, a table-driven scalar loop otherwise.
+ */
+
+#define SCAN_BLOCK 32
+
+/* Classes of bytes, combined into the `set` argument */
+enum {
+    SCAN_NEWLINE  = 1 << 0,   /* '\n' */
+    SCAN_SEMI     = 1 << 1,   /* ';' */
+    SCAN_COMMA    = 1 << 2,   /* ',' */
+    SCAN_COLON    = 1 << 3,   /* ':' */
+    SCAN_QUOTE    = 1 << 4,   /* '"' */
+    SCAN_LBRACKET = 1 << 5,   /* '[' */
+    SCAN_RBRACKET = 1 << 6,   /* ']' */
+    SCAN_SPACE    = 1 << 7,   /* ' ' and \t \n \v \f \r */
+    SCAN_NUL      = 1 << 8    /* '\0' */
+};
+
+/* Mask of the SCAN_BLOCK bytes at `p`, all of which must be readable */
+uint32_t scan_block(const char *p, unsigned set);
+
+/* Same for the `n` (< SCAN_BLOCK) bytes at `p`; no byte past them is read
+ * and their bits are clear */
+uint32_t scan_tail(const char *p, int n, unsigned set);
+
+/* Name of the kernel in use ("avx2", "sse2" or "scalar") */
+const char *scan_kernel(void);
+
+/* Switch to the named kernel, if this CPU can run it (for tests and
+ * benchmarks; not thread-safe) */
+bool scan_set_kernel(const char *name);
+
+/* Index of the lowest set bit of a non-zero mask */
+static inline int scan_first(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1)) { mask >>= 1; i++; }
+    return i;
+#endif
+}
+
+#endif /* SCAN_H */
@@ -1,30 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 
 #include "second_pass.h"
 #include "error.h"
 #include "symbol_table.h"
+#include "utils.h"
+#include "stats.h"
 
-/* Second pass: encode each instruction into cpu->memory */
-bool second_pass(ParsedLine *lines, int line_count, CPUState *cpu) {
-    for (int i = 0; i < line_count; i++) {
-        ParsedLine *pl = &lines[i];
-
-        /* Handle .entry directives: mark symbol as entry */
-        if (pl->type == STMT_DIRECTIVE && pl->dir_type == DIR_ENTRY) {
-            if (!update_symbol_type(cpu->symtab, pl->directive_args, SYM_ENTRY)) {
-                print_error("Invalid .entry for label: %s", pl->directive_args);
-            }
-            continue; /* no machine code emitted */
+/* Second-pass work for one statement; returns the number of words encoded */
+int second_pass_line(const ParsedLine *pl, CPUState *cpu, uint16_t words[MAX_INSTRUCTION_WORDS]) {
+    /* Handle .entry directives: mark symbol as entry */
+    if (pl->type == STMT_DIRECTIVE && pl->dir_type == DIR_ENTRY) {
+        if (!update_symbol_type(cpu->symtab, pl->directive_args, SYM_ENTRY)) {
+            print_error("Invalid .entry for label: %s", pl->directive_args);
         }
+        return 0; /* no machine code emitted */
+    }
 
-        if (pl->type != STMT_INSTRUCTION) continue;
+    if (pl->type != STMT_INSTRUCTION) return 0;
+
+    return encode_instruction(pl, cpu, words);
+}
 
-        uint16_t words[3];
-        int count = encode_instruction(pl, cpu, words);
+/* Encode lines[first, last) into cpu->memory from cpu->PC on */
+static void encode_range(const ParsedLine *lines, int first, int last, CPUState *cpu) {
+    ErrorSink *diag = error_bound_sink();
+    for (int i = first; i < last && !error_sink_full(diag); i++) {
+        uint16_t words[MAX_INSTRUCTION_WORDS];
+        error_sink_at(diag, lines[i].line_number);
+        int count = second_pass_line(&lines[i], cpu, words);
         for (int w = 0; w < count; w++) {
             cpu->memory[cpu->PC++] = words[w];
         }
     }
-    return (get_error_count() == 0);
 }
 
+/* One encoder's share: its own diagnostics and external-use list, and its
+ * own slice of the shared code image */
+typedef struct {
+    const ParsedLine *lines;
+    int               first, last;
+    CPUState          cpu;
+    Arena             arena;     /* the external-use nodes */
+    ErrorSink         sink;
+    Stats             stats;     /* counts, added to the caller's afterwards */
+} Encoder;
+
+/* Encode the lines of encoders[t] (a run_split piece) */
+static void encoder_main(void *encoders, int t) {
+    Encoder *e = (Encoder *)encoders + t;
+    ErrorSink *outer = error_bound_sink();
+    Stats *outer_stats = stats_bound();
+    jmp_buf recover;
+    e->sink.recover = &recover;
+    error_bind_sink(&e->sink);
+    stats_bind(stats_enabled ? &e->stats : NULL);
+    /* running out of memory is reported to e->sink, which sends the file
+     * down the serial path */
+    if (setjmp(recover) == 0) {
+        for (int i = e->first; i < e->last; i++) {
+            const ParsedLine *pl = &e->lines[i];
+            if (pl->type != STMT_INSTRUCTION) continue;
+            e->sink.line = pl->line_number;
+            e->cpu.PC += encode_instruction(pl, &e->cpu, e->cpu.memory + e->cpu.PC);
+        }
+    }
+    error_bind_sink(outer);
+    stats_bind(outer_stats);
+}
+
+/*
+ * Encode a large file on several threads.  Every instruction's word count
+ * is known from the first pass, so each encoder starts at the prefix sum of
+ * the words before its lines.  .entry lines, the only ones that change the
+ * symbol table, are handled first.  The external-use lists are merged so
+ * the result is the one the serial loop builds.  If anything is reported
+ * this gives up (returning false) and the serial loop runs instead, so
+ * diagnostics come out in source order; repeating the .entry lines is
+ * harmless.
+ */
+static bool second_pass_parallel(ParsedLine *lines, int line_count, CPUState *cpu) {
+    int nenc = split_count(line_count, PARALLEL_MIN_LINES, MAX_SPLIT);
+    if (nenc < 2) return false;
+
+    ErrorSink *outer = error_bound_sink();
+    Stats *outer_stats = stats_bound();
+    ErrorSink quiet;
+    Stats entry_stats;      /* counts of the .entry lines */
+    error_sink_init(&quiet);
+    stats_init(&entry_stats);
+    error_bind_sink(&quiet);
+    if (outer_stats) stats_bind(&entry_stats);
+    for (int i = 0; i < line_count; i++) {
+        if (lines[i].type == STMT_DIRECTIVE && lines[i].dir_type == DIR_ENTRY)
+            second_pass_line(&lines[i], cpu, NULL);
+    }
+    error_bind_sink(outer);
+    stats_bind(outer_stats);
+    bool ok = quiet.count == 0;
+    error_sink_free(&quiet);
+    if (!ok) {
+        stats_free(&entry_stats);
+        return false;
+    }
+
+    Encoder enc[MAX_SPLIT];
+    int line = 0;
+    uint32_t PC = cpu->PC;
+    for (int t = 0; t < nenc; t++) {
+        Encoder *e = &enc[t];
+        e->lines = lines;
+        e->first = line;
+        e->last = (int)((long long)line_count * (t + 1) / nenc);
+        e->cpu = *cpu;
+        e->cpu.PC = PC;
+        e->cpu.ext_uses = NULL;
+        e->cpu.arena = &e->arena;
+        arena_init(&e->arena, 0);
+        error_sink_init(&e->sink);
+        stats_init(&e->stats);
+        for (; line < e->last; line++) {
+            const Instruction *ins = &lines[line].ins;
+            if (lines[line].type == STMT_INSTRUCTION && ins->opcode >= 0)
+                PC += ins->count;
+        }
+    }
+    run_split(nenc, encoder_main, enc);
+
+    for (int t = 0; t < nenc; t++)
+        ok = ok && enc[t].sink.count == 0;
+    if (ok) {
+        /* newest first, like add_external_use: the last encoder's list,
+         * then the one before it, and so on */
+        ExternalUse *merged = NULL, **tail = &merged;
+        for (int t = nenc - 1; t >= 0; t--) {
+            for (const ExternalUse *u = enc[t].cpu.ext_uses; u; u = u->next) {
+                ExternalUse *node = arena_alloc(cpu->arena, sizeof(*node));
+                if (!node) error_exit("Memory allocation failed");
+                *node = *u;
+                *tail = node;
+                tail = &node->next;
+            }
+        }
+        *tail = cpu->ext_uses;
+        cpu->ext_uses = merged;
+        cpu->PC = PC;
+    }
+    /* after a failure the serial loop does the counting */
+    Stats *stats = ok ? outer_stats : NULL;
+    if (stats) stats_merge(stats, &entry_stats);
+    stats_free(&entry_stats);
+    for (int t = 0; t < nenc; t++) {
+        if (stats) stats_merge(stats, &enc[t].stats);
+        stats_free(&enc[t].stats);
+        arena_free(&enc[t].arena);
+        error_sink_free(&enc[t].sink);
+    }
+    return ok;
+}
+
+/* Second pass: encode each instruction into cpu->memory */
+bool second_pass(ParsedLine *lines, int line_count, CPUState *cpu) {
+    if (!second_pass_parallel(lines, line_count, cpu))
+        encode_range(lines, 0, line_count, cpu);
+    return (get_error_count() == 0);
+}
@@ -7,4 +7,8 @@
 
 bool second_pass(ParsedLine *lines, int line_count, CPUState *cpu);
 
+/* Handle a single statement (.entry or instruction). Encoded words are
+ * written to `words`; the caller advances cpu->PC by the returned count. */
+int  second_pass_line(const ParsedLine *pl, CPUState *cpu, uint16_t words[MAX_INSTRUCTION_WORDS]);
+
 #endif /* SECOND_PASS_H */
@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "serve.h"
+#include "error.h"
+#include "utils.h"
+
+/* Socket file to remove when a termination signal arrives */
+static char serve_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static void on_terminate(int sig) {
+    (void)sig;
+    unlink(serve_path);
+    _exit(0);
+}
+
+/* Fill in a Unix socket address; false if the path does not fit */
+static bool make_address(const char *sock_path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr->sun_path)) return false;
+    strcpy(addr->sun_path, sock_path);
+    return true;
+}
+
+static bool send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+typedef struct {
+    int        listen_fd;
+    AssembleFn assemble;
+} Server;
+
+/* Assemble the files of one request, sending each file's diagnostics as
+ * soon as it is done */
+static void handle_client(int fd, AssembleFn assemble, Arena *arena, Arena *scratch) {
+    int in_fd = dup(fd);
+    FILE *in = in_fd >= 0 ? fdopen(in_fd, "r") : NULL;
+    if (!in) {
+        if (in_fd >= 0) close(in_fd);
+        return;
+    }
+
+    ErrorSink diag;
+    jmp_buf recover;
+    error_sink_init(&diag);
+    diag.recover = &recover;
+    char *path = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    volatile bool all_ok = true;
+    bool connected = true;
+    while ((n = getdelim(&path, &cap, '\0', in)) > 1) {
+        error_sink_configure(&diag, path, NULL);
+        diag.count = 0;     /* errors of earlier files are not this one's */
+        error_bind_sink(&diag);
+        if (path[0] != '/') {
+            print_error("Daemon requests need absolute paths: %s", path);
+            all_ok = false;
+        } else {
+            worker_job_begin();
+            /* error_exit() fails this file instead of ending the daemon */
+            if (setjmp(recover) == 0) {
+                if (!assemble(path, arena, scratch)) all_ok = false;
+            } else {
+                all_ok = false;
+                arena_reset(arena);
+                arena_reset(scratch);
+            }
+            worker_job_end();
+        }
+        error_bind_sink(NULL);
+        size_t len;
+        char *text = error_sink_render(&diag, &len);
+        connected = send_all(fd, text, len);
+        free(text);
+        if (!connected) break;
+    }
+    /* only a complete request gets a status; otherwise the client is gone */
+    if (connected && n == 1) {
+        char status[2] = { '\0', all_ok ? '0' : '1' };
+        send_all(fd, status, sizeof(status));
+    }
+
+    free(path);
+    error_sink_free(&diag);
+    fclose(in);
+}
+
+/* Each serving thread keeps its arenas warm across connections */
+static void *serve_loop(void *arg) {
+    Server *srv = arg;
+    Arena arena, scratch;
+    arena_init(&arena, 0);
+    arena_init(&scratch, 0);
+    for (;;) {
+        int fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            print_system_error("accept");
+            break;
+        }
+        handle_client(fd, srv->assemble, &arena, &scratch);
+        close(fd);
+    }
+    arena_free(&arena);
+    arena_free(&scratch);
+    return NULL;
+}
+
+bool serve(const char *sock_path, int threads, AssembleFn assemble) {
+    struct sockaddr_un addr;
+    if (!make_address(sock_path, &addr)) {
+        print_error("Socket path too long: %s", sock_path);
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { print_system_error("socket"); return false; }
+
+    /* a socket left behind by a daemon that was killed refuses
+     * connections and is replaced; a live daemon keeps its path */
+    struct stat st;
+    if (stat(sock_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            print_error("A daemon is already running on %s", sock_path);
+            close(fd);
+            return false;
+        }
+        if (errno != ECONNREFUSED) {
+            print_system_error(sock_path);
+            close(fd);
+            return false;
+        }
+        unlink(sock_path);
+        /* the failed connect leaves the socket unusable for bind */
+        close(fd);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) { print_system_error("socket"); return false; }
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        print_system_error(sock_path);
+        close(fd);
+        return false;
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        print_system_error("listen");
+        close(fd);
+        unlink(sock_path);
+        return false;
+    }
+
+    strcpy(serve_path, sock_path);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_terminate;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    Server srv = { fd, assemble };
+    for (int t = 1; t < threads; t++) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, serve_loop, &srv) == 0)
+            pthread_detach(th);
+    }
+    serve_loop(&srv);
+
+    close(fd);
+    unlink(sock_path);
+    return false;
+}
+
+/* Current directory in a malloc'ed buffer, or NULL */
+static char *current_dir(void) {
+    size_t cap = 256;
+    for (;;) {
+        char *buf = malloc(cap);
+        if (!buf) return NULL;
+        if (getcwd(buf, cap)) return buf;
+        free(buf);
+        if (errno != ERANGE) return NULL;
+        cap *= 2;
+    }
+}
+
+/* Send the request: every path made absolute, then an empty string */
+static bool send_request(int fd, char *const files[], int count) {
+    char *cwd = NULL;
+    for (int i = 0; i < count; i++) {
+        if (files[i][0] != '/') {
+            if (!cwd && !(cwd = current_dir())) return false;
+            if (!send_all(fd, cwd, strlen(cwd)) || !send_all(fd, "/", 1)) {
+                free(cwd);
+                return false;
+            }
+        }
+        if (!send_all(fd, files[i], strlen(files[i]) + 1)) {
+            free(cwd);
+            return false;
+        }
+    }
+    free(cwd);
+    return send_all(fd, "", 1);
+}
+
+int forward_batch(const char *sock_path, char *const files[], int count) {
+    struct sockaddr_un addr;
+    if (!make_address(sock_path, &addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int status = -1;
+    bool in_text = true;
+    if (send_request(fd, files, count)) {
+        char buf[4096];
+        ssize_t n;
+        while (status < 0 && (n = read(fd, buf, sizeof(buf))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            char *p = buf;
+            if (in_text) {
+                char *end = memchr(buf, '\0', (size_t)n);
+                fwrite(buf, 1, end ? (size_t)(end - buf) : (size_t)n, stderr);
+                if (!end) continue;
+                in_text = false;
+                p = end + 1;
+            }
+            if (p < buf + n)
+                status = *p == '0' ? 0 : 1;
+        }
+    }
+    close(fd);
+    if (status < 0) {
+        print_error("Assembler daemon on %s dropped the request", sock_path);
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,31 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdbool.h>
+#include "batch.h"
+
+/*
+ * Wire format on the Unix socket.  The client sends NUL-terminated
+ * absolute source paths and an empty string to end the request.  The
+ * daemon answers with the diagnostics text, a NUL, and one status byte
+ * ('0' if every file assembled, '1' otherwise), then closes the connection.
+ */
+
+/*
+ * Run the daemon: listen on `sock_path` and assemble each request's files
+ * with `assemble`, writing the outputs next to the sources as a normal run
+ * does.  `threads` connections are served at once; every serving thread
+ * keeps its arenas between requests.  Returns only if the socket cannot
+ * be set up or a termination signal arrives; the socket file is removed.
+ */
+bool serve(const char *sock_path, int threads, AssembleFn assemble);
+
+/*
+ * Send `files` to the daemon on `sock_path` and copy its diagnostics to
+ * stderr.  Returns 0 or 1 as the exit status of the run, or -1 if no
+ * daemon is listening (nothing has been done and the caller should
+ * assemble in-process).
+ */
+int forward_batch(const char *sock_path, char *const files[], int count);
+
+#endif /* SERVE_H */
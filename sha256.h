@@ -0,0 +1,21 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+/* Incremental SHA-256 (FIPS 180-4) */
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;       /* bytes hashed so far */
+    uint8_t  block[64];    /* pending partial block */
+    size_t   used;
+} Sha256;
+
+void sha256_init(Sha256 *h);
+void sha256_update(Sha256 *h, const void *data, size_t len);
+void sha256_final(Sha256 *h, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif /* SHA256_H */
@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source.h"
+#include "scan.h"
+#include "error.h"
+
+#define INITIAL_READ_CAP  (64 * 1024)
+
+/* Read everything from fd into one heap block. `hint` is the expected size
+ * (0 if unknown, e.g. for pipes); a correct hint means a single read call. */
+static bool read_all(int fd, size_t hint, char **out, size_t *out_size) {
+    size_t cap = hint ? hint + 1 : INITIAL_READ_CAP;
+    size_t len = 0;
+    char *buf = malloc(cap);
+    if (!buf) return false;
+
+    for (;;) {
+        if (len == cap) {
+            size_t newcap = cap * 2;
+            char *tmp = realloc(buf, newcap);
+            if (!tmp) { free(buf); return false; }
+            buf = tmp;
+            cap = newcap;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0) { free(buf); return false; }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+    *out = buf;
+    *out_size = len;
+    return true;
+}
+
+/* Append the line [start, stop) to the index */
+static bool add_line(LineView **lines, size_t *cap, int *n, const char *start, const char *stop) {
+    if ((size_t)*n >= *cap) {
+        *cap *= 2;
+        LineView *tmp = realloc(*lines, sizeof(*tmp) * *cap);
+        if (!tmp) return false;
+        *lines = tmp;
+    }
+    LineView *l = &(*lines)[*n];
+    l->ptr = start;
+    l->len = (int)(stop - start);
+    l->line_no = *n + 1;
+    l->parsed = NULL;
+    (*n)++;
+    return true;
+}
+
+/* Build the (pointer, length) index of all lines in sb->data, finding the
+ * newlines of SCAN_BLOCK bytes at a time */
+static bool index_lines(SourceBuffer *sb) {
+    /* rough guess of ~32 bytes per line avoids most regrowth */
+    size_t cap = sb->size / 32 + 16;
+    LineView *lines = malloc(sizeof(*lines) * cap);
+    if (!lines) return false;
+
+    int n = 0;
+    const char *data = sb->data;
+    const char *start = data;
+    size_t size = sb->size;
+    for (size_t off = 0; off < size; off += SCAN_BLOCK) {
+        uint32_t nl = size - off >= SCAN_BLOCK
+                    ? scan_block(data + off, SCAN_NEWLINE)
+                    : scan_tail(data + off, (int)(size - off), SCAN_NEWLINE);
+        while (nl) {
+            const char *stop = data + off + scan_first(nl);
+            if (!add_line(&lines, &cap, &n, start, stop)) { free(lines); return false; }
+            start = stop + 1;
+            nl &= nl - 1;
+        }
+    }
+    /* a last line without a newline */
+    if (start < data + size && !add_line(&lines, &cap, &n, start, data + size)) {
+        free(lines);
+        return false;
+    }
+
+    sb->lines = lines;
+    sb->line_count = n;
+    return true;
+}
+
+bool load_source(const char *fname, SourceBuffer *sb) {
+    memset(sb, 0, sizeof(*sb));
+
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) { print_system_error("open"); return false; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) { print_system_error("stat"); close(fd); return false; }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            sb->data = map;
+            sb->size = (size_t)st.st_size;
+            sb->mapped = true;
+        }
+    }
+    if (!sb->mapped) {
+        size_t hint = S_ISREG(st.st_mode) ? (size_t)st.st_size : 0;
+        if (!read_all(fd, hint, &sb->data, &sb->size)) {
+            print_system_error("read");
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+
+    if (!index_lines(sb)) {
+        print_system_error("index");
+        free_source(sb);
+        return false;
+    }
+    return true;
+}
+
+bool load_source_memory(const char *data, size_t size, SourceBuffer *sb) {
+    memset(sb, 0, sizeof(*sb));
+    sb->data = (char *)data;
+    sb->size = size;
+    sb->borrowed = true;
+    if (!index_lines(sb)) {
+        free_source(sb);
+        return false;
+    }
+    return true;
+}
+
+void free_source(SourceBuffer *sb) {
+    if (sb->mapped)
+        munmap(sb->data, sb->size);
+    else if (!sb->borrowed)
+        free(sb->data);
+    free(sb->lines);
+    memset(sb, 0, sizeof(*sb));
+}
@@ -0,0 +1,41 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct ParsedLine;
+
+/* One line of text: a (pointer, length) view into a buffer owned elsewhere.
+ * The text is NOT NUL-terminated and does not include the newline. */
+typedef struct {
+    const char *ptr;
+    int         len;
+    int         line_no;   /* 1-based line number in the original source */
+    const struct ParsedLine *parsed;  /* statement macro expansion already
+                                         parsed (then there is no text), or NULL */
+} LineView;
+
+/* A whole source file held in a single buffer plus an index of its lines */
+typedef struct {
+    char     *data;        /* file contents (mmap'ed or one heap block) */
+    size_t    size;        /* number of bytes in data */
+    bool      mapped;      /* true if data must be munmap'ed */
+    bool      borrowed;    /* true if data belongs to the caller */
+    LineView *lines;       /* one view per source line, pointing into data */
+    int       line_count;
+} SourceBuffer;
+
+/* Load `fname` with a single mmap (regular files) or one sized read
+ * (pipes and other streams) and build the line index.
+ * Returns false and reports the failure via print_system_error on error. */
+bool load_source(const char *fname, SourceBuffer *sb);
+
+/* Index `size` bytes already in memory without copying them; the caller
+ * keeps `data` alive until free_source.  Returns false if out of memory. */
+bool load_source_memory(const char *data, size_t size, SourceBuffer *sb);
+
+/* Release the buffer and the line index */
+void free_source(SourceBuffer *sb);
+
+#endif /* SOURCE_H */
@@ -1,23 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
 
+/* used only by threads that have no sink bound */
 static int error_count = 0;
 
+static pthread_key_t sink_key;
+static pthread_once_t sink_once = PTHREAD_ONCE_INIT;
+
+static void make_sink_key(void) {
+    pthread_key_create(&sink_key, NULL);
+}
+
+static ErrorSink *current_sink(void) {
+    pthread_once(&sink_once, make_sink_key);
+    return pthread_getspecific(sink_key);
+}
+
+void error_bind_sink(ErrorSink *sink) {
+    pthread_once(&sink_once, make_sink_key);
+    pthread_setspecific(sink_key, sink);
+}
+
+ErrorSink *error_bound_sink(void) {
+    return current_sink();
+}
+
+void error_sink_init(ErrorSink *sink) {
+    sink->count = 0;
+    sink->records = NULL;
+    sink->record_count = 0;
+    sink->record_cap = 0;
+    arena_init(&sink->arena, 0);
+    sink->file = NULL;
+    sink->line = 0;
+    sink->max_errors = 0;
+    sink->format = DIAG_TEXT;
+    sink->callback = NULL;
+    sink->user = NULL;
+    sink->recover = NULL;
+    memset(sink->codes, 0, sizeof(sink->codes));
+}
+
+void error_sink_free(ErrorSink *sink) {
+    free(sink->records);
+    sink->records = NULL;
+    sink->record_count = 0;
+    sink->record_cap = 0;
+    memset(sink->codes, 0, sizeof(sink->codes));
+    arena_free(&sink->arena);
+}
+
+void error_sink_configure(ErrorSink *sink, const char *file, const DiagOptions *opts) {
+    sink->file = file;
+    sink->line = 0;
+    if (opts) {
+        sink->max_errors = opts->max_errors;
+        sink->format = opts->format;
+    }
+}
+
+/* Growable text for rendering */
+typedef struct {
+    char  *p;
+    size_t len;
+    size_t cap;
+    bool   failed;
+} Text;
+
+static bool text_reserve(Text *t, size_t n) {
+    if (t->failed) return false;
+    if (t->len + n + 1 <= t->cap) return true;
+    size_t cap = t->cap ? t->cap * 2 : 1024;
+    while (cap < t->len + n + 1) cap *= 2;
+    char *tmp = realloc(t->p, cap);
+    if (!tmp) { t->failed = true; return false; }
+    t->p = tmp;
+    t->cap = cap;
+    return true;
+}
+
+static void text_put(Text *t, const char *s, size_t n) {
+    if (!text_reserve(t, n)) return;
+    memcpy(t->p + t->len, s, n);
+    t->len += n;
+}
+
+static void text_printf(Text *t, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (n < 0 || !text_reserve(t, (size_t)n)) return;
+    va_start(args, fmt);
+    vsnprintf(t->p + t->len, t->cap - t->len, fmt, args);
+    va_end(args);
+    t->len += (size_t)n;
+}
+
+static void text_json_string(Text *t, const char *s) {
+    text_put(t, "\"", 1);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            char esc[2] = { '\\', (char)c };
+            text_put(t, esc, 2);
+        } else if (c == '\n') {
+            text_put(t, "\\n", 2);
+        } else if (c == '\t') {
+            text_put(t, "\\t", 2);
+        } else if (c < 0x20) {
+            text_printf(t, "\\u%04x", c);
+        } else {
+            text_put(t, (const char *)&c, 1);
+        }
+    }
+    text_put(t, "\"", 1);
+}
+
+static void render_record(Text *t, const ErrorSink *sink, const Diagnostic *d) {
+    if (sink->format == DIAG_JSON) {
+        text_put(t, "{\"severity\":", 12);
+        text_json_string(t, d->severity == DIAG_ERROR ? "error" : "system");
+        text_put(t, ",\"file\":", 8);
+        if (sink->file) text_json_string(t, sink->file);
+        else text_put(t, "null", 4);
+        if (d->line > 0) text_printf(t, ",\"line\":%d", d->line);
+        else text_put(t, ",\"line\":null", 12);
+        text_put(t, ",\"code\":", 8);
+        text_json_string(t, d->code);
+        text_put(t, ",\"message\":", 11);
+        text_json_string(t, d->message);
+        text_put(t, "}\n", 2);
+        return;
+    }
+    /* "file:line: Error: message\n", all in one reservation */
+    size_t file_len = sink->file ? strlen(sink->file) : 0;
+    size_t msg_len = strlen(d->message);
+    if (!text_reserve(t, file_len + msg_len + 32)) return;
+    char num[16];
+    int n = 0;
+    for (unsigned v = d->line > 0 ? (unsigned)d->line : 0; v; v /= 10)
+        num[sizeof(num) - ++n] = (char)('0' + v % 10);
+    char *o = t->p + t->len;
+    if (sink->file) {
+        memcpy(o, sink->file, file_len);
+        o += file_len;
+        if (n) *o++ = ':';
+    } else if (n) {
+        memcpy(o, "line ", 5);
+        o += 5;
+    }
+    memcpy(o, num + sizeof(num) - n, (size_t)n);
+    o += n;
+    if (sink->file || n) {
+        memcpy(o, ": ", 2);
+        o += 2;
+    }
+    if (d->severity == DIAG_ERROR) {
+        memcpy(o, "Error: ", 7);
+        o += 7;
+    }
+    memcpy(o, d->message, msg_len);
+    o += msg_len;
+    *o++ = '\n';
+    t->len = (size_t)(o - t->p);
+}
+
+/* Records without a line sort last */
+static unsigned by_line_key(const Diagnostic *d) {
+    return (unsigned)d->line - 1;
+}
+
+/* By line; records sit in report order in one array, so their addresses
+ * break ties */
+static int by_line(const void *a, const void *b) {
+    const Diagnostic *x = *(const Diagnostic *const *)a;
+    const Diagnostic *y = *(const Diagnostic *const *)b;
+    unsigned lx = by_line_key(x), ly = by_line_key(y);
+    if (lx != ly) return lx < ly ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
+
+char *error_sink_render(ErrorSink *sink, size_t *len) {
+    *len = 0;
+    if (sink->record_count == 0) return NULL;
+
+    Text t = { NULL, 0, 0, false };
+    bool sorted = true;
+    for (int i = 1; i < sink->record_count && sorted; i++)
+        sorted = by_line_key(&sink->records[i - 1]) <= by_line_key(&sink->records[i]);
+    if (sorted) {
+        for (int i = 0; i < sink->record_count; i++)
+            render_record(&t, sink, &sink->records[i]);
+    } else {
+        const Diagnostic **order = malloc(sizeof(*order) * sink->record_count);
+        if (!order) t.failed = true;
+        for (int i = 0; order && i < sink->record_count; i++)
+            order[i] = &sink->records[i];
+        if (order) qsort(order, sink->record_count, sizeof(*order), by_line);
+        for (int i = 0; order && i < sink->record_count; i++)
+            render_record(&t, sink, order[i]);
+        free(order);
+    }
+    sink->record_count = 0;
+    memset(sink->codes, 0, sizeof(sink->codes));
+    arena_reset(&sink->arena);
+    if (t.failed) {
+        free(t.p);
+        return NULL;
+    }
+    if (t.p) t.p[t.len] = '\0';
+    *len = t.len;
+    return t.p;
+}
+
+void error_sink_flush(ErrorSink *sink, FILE *out) {
+    size_t len;
+    char *text = error_sink_render(sink, &len);
+    if (text) fwrite(text, 1, len, out);
+    free(text);
+}
+
+/*
+ * Stable identifier of a message: its format string in lower case with the
+ * conversions left out and every other run of punctuation and blanks turned
+ * into one '-', so "Invalid .entry for label: %s" is
+ * "invalid-entry-for-label".
+ */
+static char *message_code(Arena *arena, const char *fmt) {
+    char code[64];
+    size_t n = 0;
+    for (const char *p = fmt; *p && n < sizeof(code) - 1; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '%') {
+            p++;
+            while (*p && strchr("-+ #0123456789.*hlLqjzt", *p)) p++;
+            if (!*p) break;
+            c = ' ';
+        }
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            code[n++] = (char)c;
+        } else if (c >= 'A' && c <= 'Z') {
+            code[n++] = (char)(c - 'A' + 'a');
+        } else if (n > 0 && code[n - 1] != '-') {
+            code[n++] = '-';
+        }
+    }
+    while (n > 0 && code[n - 1] == '-') n--;
+    return arena_strndup(arena, code, n);
+}
+
+/* Keep a record of the message, or hand it to the callback */
+static void sink_report(ErrorSink *sink, DiagSeverity severity, const char *code,
+                        const char *fmt, va_list args) {
+    char buf[256];
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(buf, sizeof(buf), fmt, copy);
+    va_end(copy);
+    if (n < 0) return;
+    /* drop the message rather than fail the assembly */
+    char *message = arena_alloc(&sink->arena, (size_t)n + 1);
+    if (!message) return;
+    if (n < (int)sizeof(buf)) memcpy(message, buf, (size_t)n + 1);
+    else vsnprintf(message, (size_t)n + 1, fmt, args);
+    Diagnostic d = { severity, sink->line, code, message };
+
+    if (!d.code) {
+        /* the same few messages tend to repeat */
+        const char **slot = sink->codes[((uintptr_t)fmt >> 3) % DIAG_CODE_CACHE];
+        if (slot[0] != fmt) {
+            slot[1] = message_code(&sink->arena, fmt);
+            slot[0] = slot[1] ? fmt : NULL;
+        }
+        d.code = slot[1];
+    }
+    /* out of memory for the code: keep the message under a generic one */
+    if (!d.code) d.code = "error";
+    if (sink->callback) {
+        sink->callback(sink->user, &d);
+        /* the message and the cached codes go with the arena */
+        arena_reset(&sink->arena);
+        memset(sink->codes, 0, sizeof(sink->codes));
+        return;
+    }
+    if (sink->record_count == sink->record_cap) {
+        int cap = sink->record_cap ? sink->record_cap * 2 : 16;
+        Diagnostic *tmp = realloc(sink->records, sizeof(*tmp) * cap);
+        if (!tmp) return;
+        sink->records = tmp;
+        sink->record_cap = cap;
+    }
+    sink->records[sink->record_count++] = d;
+}
+
+static void sink_printf(ErrorSink *sink, DiagSeverity severity, const char *code,
+                        const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    sink_report(sink, severity, code, fmt, args);
+    va_end(args);
+}
+
 void increment_error_count(void) {
-    error_count++;
+    ErrorSink *sink = current_sink();
+    if (sink) sink->count++;
+    else error_count++;
 }
 
 int get_error_count(void) {
-    return error_count;
+    ErrorSink *sink = current_sink();
+    return sink ? sink->count : error_count;
 }
 
 void print_error(const char *fmt, ...) {
     va_list args;
-    fprintf(stderr, "Error: ");
+    ErrorSink *sink = current_sink();
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    if (sink) {
+        /* past the limit errors are only counted */
+        if (!error_sink_full(sink))
+            sink_report(sink, DIAG_ERROR, NULL, fmt, args);
+    } else {
+        /* one write where it fits, as stderr is unbuffered */
+        char buf[512];
+        va_list copy;
+        va_copy(copy, args);
+        int n = vsnprintf(buf + 7, sizeof(buf) - 8, fmt, copy);
+        va_end(copy);
+        if (n >= 0 && n < (int)sizeof(buf) - 8) {
+            memcpy(buf, "Error: ", 7);
+            buf[7 + n] = '\n';
+            fwrite(buf, 1, (size_t)n + 8, stderr);
+        } else {
+            fprintf(stderr, "Error: ");
+            vfprintf(stderr, fmt, args);
+            fputc('\n', stderr);
+        }
+    }
     va_end(args);
-    fputc('\n', stderr);
     increment_error_count();
 }
+
+void print_system_error(const char *what) {
+    char msg[256];
+    if (strerror_r(errno, msg, sizeof(msg)) != 0)
+        snprintf(msg, sizeof(msg), "error %d", errno);
+    ErrorSink *sink = current_sink();
+    if (sink) {
+        sink_printf(sink, DIAG_SYSTEM, "system", "%s: %s", what, msg);
+    } else {
+        fprintf(stderr, "%s: %s\n", what, msg);
+    }
+}
+
+void error_unwind(const char *msg) {
+    ErrorSink *sink = current_sink();
+    if (!sink || !sink->recover) return;
+    if (!error_sink_full(sink)) sink_printf(sink, DIAG_ERROR, "fatal", "%s", msg);
+    sink->count++;
+    longjmp(*sink->recover, 1);
+}
@@ -1,8 +1,102 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+#include "arena.h"
+
+typedef enum {
+    DIAG_ERROR,     /* counted; "Error: <message>" */
+    DIAG_SYSTEM     /* a failed system call, not counted; "<what>: <reason>" */
+} DiagSeverity;
+
+/* One reported diagnostic */
+typedef struct {
+    DiagSeverity severity;
+    int          line;      /* source line, 0 if not tied to one */
+    const char  *code;      /* stable identifier, e.g. "duplicate-symbol" */
+    const char  *message;
+} Diagnostic;
+
+/* Receives one diagnostic at a time; its strings last only for the call */
+typedef void (*ErrorCallback)(void *user, const Diagnostic *d);
+
+/* How error_sink_flush() writes the records */
+typedef enum {
+    DIAG_TEXT,      /* "file:line: Error: message" */
+    DIAG_JSON       /* one JSON object per line */
+} DiagFormat;
+
+/* Slots of the per-sink cache of message codes */
+#define DIAG_CODE_CACHE 8
+
+/* Settings a driver applies to the sink of every file it assembles */
+typedef struct {
+    int        max_errors;  /* 0: no limit */
+    DiagFormat format;
+} DiagOptions;
+
+/*
+ * Diagnostics of one assembly.  Records are kept (their text in `arena`)
+ * until the sink is flushed, so several files can be assembled at once and
+ * still report in a fixed order.  A sink is used by one thread at a time.
+ */
+typedef struct {
+    int         count;         /* number of errors reported */
+    Diagnostic *records;
+    int         record_count;
+    int         record_cap;
+    Arena       arena;
+    const char *file;          /* named in every record, may be NULL */
+    int         line;          /* line being worked on, 0 if none */
+    int         max_errors;    /* errors past this many are dropped; 0: no limit */
+    DiagFormat  format;
+    const char *codes[DIAG_CODE_CACHE][2];  /* format string -> its code */
+    ErrorCallback callback;  /* if set, messages go here instead of being kept */
+    void  *user;
+    jmp_buf *recover;        /* if set, error_exit() unwinds here instead of exiting */
+} ErrorSink;
+
 void print_error(const char *fmt, ...);
 void increment_error_count(void);
 int get_error_count(void);
 
+/* Like perror(): report `what` with the current errno (not counted as an error) */
+void print_system_error(const char *what);
+
+void error_sink_init(ErrorSink *sink);
+void error_sink_free(ErrorSink *sink);
+/* Apply a driver's settings to a sink for `file` */
+void error_sink_configure(ErrorSink *sink, const char *file, const DiagOptions *opts);
+/* The records sorted by line (those without one last, otherwise in the
+ * order reported) and rendered in the sink's format, in a malloc'ed and
+ * NUL-terminated buffer of *len bytes, or NULL if there are none.  The
+ * records are dropped. */
+char *error_sink_render(ErrorSink *sink, size_t *len);
+/* Render the records and write them to `out` in one go */
+void error_sink_flush(ErrorSink *sink, FILE *out);
+/* Route the calling thread's diagnostics (and error count) to `sink`.
+ * NULL restores the default: unbuffered stderr and a process-wide count. */
+void error_bind_sink(ErrorSink *sink);
+/* The sink bound to the calling thread, or NULL */
+ErrorSink *error_bound_sink(void);
+
+/* Attribute what is reported from now on to `line` (0: none).  Loops over
+ * lines look the sink up once and call this for every line. */
+static inline void error_sink_at(ErrorSink *sink, int line) {
+    if (sink) sink->line = line;
+}
+
+/* True once the sink has as many errors as it takes: the caller may stop */
+static inline bool error_sink_full(const ErrorSink *sink) {
+    return sink && sink->max_errors > 0 && sink->count >= sink->max_errors;
+}
+
+/* Report a fatal error to the bound sink and longjmp to its recovery
+ * point.  Returns only if the thread has no sink with a recovery point. */
+void error_unwind(const char *msg);
+
 #endif /* ERROR_H */
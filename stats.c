@@ -0,0 +1,181 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+#include "error.h"
+#include "utils.h"
+
+bool stats_enabled = false;
+
+static bool keep_events;
+static double epoch;
+
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "read_input", "scan_macros", "expand_macros", "first_pass", "parse",
+    "second_pass", "write_ob", "write_ent", "write_ext", "write_obj",
+};
+
+static const char *const counter_names[STAT_COUNT] = {
+    "lines", "statements", "symbol lookups", "symbol probes",
+    "macro invocations", "macro substitutions", "words emitted",
+};
+
+static void make_stats_key(void) {
+    pthread_key_create(&stats_key, NULL);
+}
+
+static double clock_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void stats_enable(bool trace) {
+    epoch = clock_seconds();
+    keep_events = trace;
+    stats_enabled = true;
+}
+
+double stats_now(void) {
+    return clock_seconds() - epoch;
+}
+
+void stats_init(Stats *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void stats_free(Stats *s) {
+    free(s->events);
+    s->events = NULL;
+    s->event_count = s->event_cap = 0;
+}
+
+void stats_bind(Stats *s) {
+    pthread_once(&stats_once, make_stats_key);
+    pthread_setspecific(stats_key, s);
+}
+
+Stats *stats_bound(void) {
+    pthread_once(&stats_once, make_stats_key);
+    return pthread_getspecific(stats_key);
+}
+
+static void push_event(Stats *s, TraceEvent e) {
+    if (s->event_count == s->event_cap) {
+        int cap = s->event_cap ? s->event_cap * 2 : 32;
+        TraceEvent *tmp = realloc(s->events, sizeof(*tmp) * cap);
+        if (!tmp) error_exit("Memory allocation failed");
+        s->events = tmp;
+        s->event_cap = cap;
+    }
+    s->events[s->event_count++] = e;
+}
+
+static void add_event(Stats *s, const char *name, const char *cat,
+                      double start, double dur, uint64_t bytes) {
+    if (keep_events) push_event(s, (TraceEvent){ name, cat, s->tid, start, dur, bytes });
+}
+
+void stats_merge(Stats *dst, Stats *src) {
+    dst->files += src->files;
+    dst->wall += src->wall;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        dst->seconds[p] += src->seconds[p];
+        dst->bytes[p] += src->bytes[p];
+    }
+    for (int c = 0; c < STAT_COUNT; c++)
+        dst->counters[c] += src->counters[c];
+    for (int i = 0; i < src->event_count; i++)
+        push_event(dst, src->events[i]);
+    src->event_count = 0;
+}
+
+void stats_add(StatCounter c, uint64_t n) {
+    Stats *s = stats_bound();
+    if (s) s->counters[c] += n;
+}
+
+void stats_phase_done(const StatMark *m, StatPhase phase, size_t bytes) {
+    Stats *s = stats_bound();
+    if (!s) return;
+    double dur = stats_now() - m->start;
+    uint64_t used = bytes > m->bytes ? bytes - m->bytes : 0;
+    s->seconds[phase] += dur;
+    s->bytes[phase] += used;
+    add_event(s, phase_names[phase], "phase", m->start, dur, used);
+}
+
+void stats_file_done(const StatMark *m, const char *path) {
+    if (!stats_enabled) return;
+    Stats *s = stats_bound();
+    if (!s) return;
+    double dur = stats_now() - m->start;
+    s->files++;
+    s->wall += dur;
+    add_event(s, path, "file", m->start, dur, 0);
+}
+
+void stats_report(const Stats *s, FILE *out) {
+    fprintf(out, "stats: %d file%s, %.3f ms\n", s->files, s->files == 1 ? "" : "s",
+            s->wall * 1e3);
+    fprintf(out, "  %-20s %12s %7s %12s\n", "phase", "ms", "share", "alloc KB");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (s->seconds[p] == 0 && s->bytes[p] == 0) continue;
+        /* the parse loop is part of the first pass */
+        const char *indent = p == PHASE_PARSE ? "  " : "";
+        char name[32];
+        snprintf(name, sizeof(name), "%s%s", indent, phase_names[p]);
+        fprintf(out, "  %-20s %12.3f %6.1f%% %12.1f\n", name, s->seconds[p] * 1e3,
+                s->wall > 0 ? 100.0 * s->seconds[p] / s->wall : 0.0, s->bytes[p] / 1024.0);
+    }
+    for (int c = 0; c < STAT_COUNT; c++)
+        fprintf(out, "  %-20s %12llu\n", counter_names[c],
+                (unsigned long long)s->counters[c]);
+    uint64_t lookups = s->counters[STAT_SYMBOL_LOOKUPS];
+    if (lookups > 0)
+        fprintf(out, "  %-20s %12.2f\n", "probes per lookup",
+                (double)s->counters[STAT_SYMBOL_PROBES] / lookups);
+}
+
+static void put_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+bool stats_write_trace(const Stats *s, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) { print_system_error(path); return false; }
+    int lanes = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    for (int i = 0; i < s->event_count; i++) {
+        const TraceEvent *e = &s->events[i];
+        if (e->tid >= lanes) lanes = e->tid + 1;
+        fputs(i ? ",\n" : "\n", f);
+        fputs("{\"name\":", f);
+        put_json_string(f, e->name);
+        /* ts and dur are in microseconds */
+        fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                e->cat, e->tid, e->start * 1e6, e->dur * 1e6);
+        if (e->bytes) fprintf(f, ",\"args\":{\"bytes\":%llu}", (unsigned long long)e->bytes);
+        fputc('}', f);
+    }
+    for (int t = 0; t < lanes; t++)
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"worker %d\"}}",
+                s->event_count || t ? ",\n" : "\n", t, t);
+    fputs("\n]}\n", f);
+    if (fclose(f) != 0) { print_system_error(path); return false; }
+    return true;
+}
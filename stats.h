@@ -0,0 +1,111 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Timed steps of one assembly, in the order they run */
+typedef enum {
+    PHASE_READ_INPUT,
+    PHASE_SCAN_MACROS,
+    PHASE_EXPAND_MACROS,
+    PHASE_FIRST_PASS,
+    PHASE_PARSE,            /* the statement loop of the first pass */
+    PHASE_SECOND_PASS,
+    PHASE_WRITE_OB,
+    PHASE_WRITE_ENT,
+    PHASE_WRITE_EXT,
+    PHASE_WRITE_OBJ,
+    PHASE_COUNT
+} StatPhase;
+
+/* Hot-path counters */
+typedef enum {
+    STAT_LINES,
+    STAT_STATEMENTS,
+    STAT_SYMBOL_LOOKUPS,
+    STAT_SYMBOL_PROBES,     /* index slots those lookups looked at */
+    STAT_MACRO_INVOCATIONS,
+    STAT_MACRO_SUBSTITUTIONS,
+    STAT_WORDS_EMITTED,
+    STAT_COUNT
+} StatCounter;
+
+/* One finished span of the trace */
+typedef struct {
+    const char *name;       /* a phase name or a file path */
+    const char *cat;        /* "phase" or "file" */
+    int         tid;
+    double      start;      /* seconds since stats_enable() */
+    double      dur;
+    uint64_t    bytes;
+} TraceEvent;
+
+/*
+ * Timings and counters of one or more assemblies.  Each thread adds to the
+ * Stats bound to it; drivers give every file its own and merge them in a
+ * fixed order, so nothing is shared between threads.
+ */
+typedef struct {
+    int         files;
+    double      wall;                  /* summed over the files */
+    double      seconds[PHASE_COUNT];
+    uint64_t    bytes[PHASE_COUNT];    /* allocated during each phase */
+    uint64_t    counters[STAT_COUNT];
+    int         tid;                   /* trace lane of the thread using it */
+    TraceEvent *events;                /* only kept with a trace */
+    int         event_count, event_cap;
+} Stats;
+
+/* Where and when a phase started */
+typedef struct {
+    double start;
+    size_t bytes;
+} StatMark;
+
+/* Set by stats_enable() before any assembly starts.  While it is false the
+ * inline helpers below do nothing but test it. */
+extern bool stats_enabled;
+
+/* Turn collection on; with `trace` the spans are kept for stats_write_trace() */
+void stats_enable(bool trace);
+
+void stats_init(Stats *s);
+void stats_free(Stats *s);
+/* Add `src` to `dst` and move its trace events over */
+void stats_merge(Stats *dst, Stats *src);
+
+/* Route the calling thread's counts to `s` (NULL: drop them) */
+void stats_bind(Stats *s);
+Stats *stats_bound(void);
+
+double stats_now(void);
+void stats_add(StatCounter c, uint64_t n);
+void stats_phase_done(const StatMark *m, StatPhase phase, size_t bytes);
+/* Close the span of a whole file started at `m` */
+void stats_file_done(const StatMark *m, const char *path);
+
+/* The table --stats prints */
+void stats_report(const Stats *s, FILE *out);
+/* The spans as a Chrome trace-event file; false if it can't be written */
+bool stats_write_trace(const Stats *s, const char *path);
+
+/* Start a phase; `bytes` is what the caller's allocator has handed out so far */
+static inline void stats_begin(StatMark *m, size_t bytes) {
+    if (stats_enabled) {
+        m->start = stats_now();
+        m->bytes = bytes;
+    }
+}
+
+static inline void stats_end(const StatMark *m, StatPhase phase, size_t bytes) {
+    if (stats_enabled) stats_phase_done(m, phase, bytes);
+}
+
+static inline void stats_count(StatCounter c, uint64_t n) {
+    if (stats_enabled) stats_add(c, n);
+}
+
+#endif /* STATS_H */
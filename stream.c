@@ -0,0 +1,315 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+#include "utils.h"
+#include "macro.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include "second_pass.h"
+#include "output.h"
+#include "error.h"
+#include "data_segment.h"
+#include "stats.h"
+
+/* flush collected data words to the spill file once this many are pending */
+#define DATA_FLUSH_WORDS  4096
+/* external uses are read back in blocks of this many records */
+#define EXT_BLOCK         256
+
+/* Header of a statement kept for the second pass.  The decoded form of an
+ * instruction is followed by the labels of its source and destination
+ * (each NUL-terminated, empty if none); a .entry by the label name.
+ * `text_len` counts the bytes that follow. */
+typedef struct {
+    char        type;             /* 'I' instruction, 'E' .entry */
+    int         line_no;
+    Instruction ins;              /* label pointers are rebuilt on reading */
+    int         text_len;
+} StmtRecord;
+
+/* One spilled use of an external symbol */
+typedef struct {
+    char name[32];
+    int  address;
+} ExtRecord;
+
+/* Keep the parts of a statement the second pass needs; false if the
+ * spill file could not take it */
+static bool spill_statement(FILE *f, const ParsedLine *pl) {
+    StmtRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.line_no = pl->line_number;
+    if (pl->type == STMT_INSTRUCTION) {
+        const char *src = pl->ins.src.label ? pl->ins.src.label : "";
+        const char *dst = pl->ins.dst.label ? pl->ins.dst.label : "";
+        size_t src_len = strlen(src) + 1, dst_len = strlen(dst) + 1;
+        rec.type = 'I';
+        rec.ins = pl->ins;
+        rec.text_len = (int)(src_len + dst_len);
+        return fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+               fwrite(src, 1, src_len, f) == src_len &&
+               fwrite(dst, 1, dst_len, f) == dst_len;
+    } else if (pl->type == STMT_DIRECTIVE && pl->dir_type == DIR_ENTRY) {
+        rec.type = 'E';
+        rec.text_len = (int)strlen(pl->directive_args);
+        return fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+               fwrite(pl->directive_args, 1, rec.text_len, f) == (size_t)rec.text_len;
+    }
+    return true;
+}
+
+/* Read the next spilled statement back into `pl`; its text lives in *buf */
+static bool read_statement(FILE *f, ParsedLine *pl, char **buf, size_t *cap) {
+    StmtRecord rec;
+    if (fread(&rec, sizeof(rec), 1, f) != 1) return false;
+    if ((size_t)rec.text_len + 1 > *cap) {
+        size_t newcap = (size_t)rec.text_len + 1;
+        char *tmp = realloc(*buf, newcap);
+        if (!tmp) error_exit("Memory allocation failed");
+        *buf = tmp;
+        *cap = newcap;
+    }
+    if (fread(*buf, 1, rec.text_len, f) != (size_t)rec.text_len) return false;
+    (*buf)[rec.text_len] = '\0';
+
+    memset(pl, 0, sizeof(*pl));
+    pl->line_number = rec.line_no;
+    if (rec.type == 'I') {
+        char *dst = *buf + strlen(*buf) + 1;
+        pl->type = STMT_INSTRUCTION;
+        pl->ins = rec.ins;
+        pl->ins.src.label = **buf ? *buf : NULL;
+        pl->ins.dst.label = *dst ? dst : NULL;
+    } else {
+        pl->type = STMT_DIRECTIVE;
+        pl->dir_type = DIR_ENTRY;
+        pl->directive_args = *buf;
+    }
+    return true;
+}
+
+/* Move pending data words to the spill file */
+static bool flush_data(FILE *f, DataSegment *ds) {
+    bool ok = fwrite(ds->words, sizeof(uint16_t), ds->count, f) == (size_t)ds->count;
+    ds->count = 0;
+    return ok;
+}
+
+/* Write a use list oldest-first (the list itself is newest-first) */
+static bool spill_uses(FILE *f, const ExternalUse *u) {
+    if (!u) return true;
+    if (!spill_uses(f, u->next)) return false;
+    ExtRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    memcpy(rec.name, u->name, sizeof(rec.name));
+    rec.address = u->address;
+    return fwrite(&rec, sizeof(rec), 1, f) == 1;
+}
+
+/* Make everything written to a spill file readable; false (reported) if
+ * any write to it failed */
+static bool spill_done(FILE *f) {
+    if (fflush(f) == 0 && !ferror(f)) return true;
+    print_system_error("write spill file");
+    return false;
+}
+
+/* Write the .ext file newest-first, matching write_externals_file, or
+ * remove it if there are no uses.  False (reported) on an I/O error. */
+static bool write_spilled_externals(const char *filename, FILE *spill) {
+    if (!spill_done(spill)) return false;
+    long size = fseek(spill, 0, SEEK_END) == 0 ? ftell(spill) : -1;
+    if (size < 0) { print_system_error("read spill file"); return false; }
+    long n = size / (long)sizeof(ExtRecord);
+    if (n == 0) {
+        remove(filename);
+        return true;
+    }
+
+    FILE *f = fopen(filename, "w");
+    if (!f) { print_system_error("open .ext"); return false; }
+    ExtRecord block[EXT_BLOCK];
+    bool ok = true;
+    while (n > 0) {
+        long take = n < EXT_BLOCK ? n : EXT_BLOCK;
+        n -= take;
+        if (fseek(spill, n * (long)sizeof(ExtRecord), SEEK_SET) != 0 ||
+            fread(block, sizeof(ExtRecord), take, spill) != (size_t)take) {
+            print_system_error("read spill file");
+            ok = false;
+            break;
+        }
+        for (long i = take - 1; i >= 0; i--)
+            write_symbol_line(f, block[i].name, block[i].address);
+    }
+    if (ferror(f) && ok) {
+        print_system_error("write .ext");
+        ok = false;
+    }
+    if (fclose(f) != 0 && ok) {
+        print_system_error("write .ext");
+        ok = false;
+    }
+    if (!ok) remove(filename);
+    return ok;
+}
+
+bool assemble_stream(const char *fname, Arena *arena, Arena *scratch) {
+    bool ok = false;
+    bool from_stdin = strcmp(fname, "-") == 0;
+    FILE *in = from_stdin ? stdin : fopen(fname, "r");
+    if (!in) { print_system_error("open"); return false; }
+
+    MacroTable mt; init_macro_table(&mt, arena);
+    MacroStream ms; init_macro_stream(&ms, &mt, in);
+    SymbolTable st; init_symbol_table(&st, arena);
+    DataSegment data_seg; init_data_segment(&data_seg);
+    CPUState cpu = {0};
+    ObjectWriter ow = {0};
+    char *base = NULL;
+    char *obname = NULL;
+    char *text = NULL; size_t text_cap = 0;
+    int IC = 0, DC = 0;
+    FILE *stmts = tmpfile();
+    FILE *data = tmpfile();
+    FILE *exts = tmpfile();
+    if (!stmts || !data || !exts) { print_system_error("tmpfile"); goto cleanup; }
+
+    /* first pass: expand, parse and count each line as it arrives */
+    ErrorSink *diag = error_bound_sink();
+    StatMark mark;
+    LineView line;
+    int statements = 0;
+    stats_begin(&mark, arena->allocated + scratch->allocated);
+    while (!error_sink_full(diag) && macro_stream_next(&ms, &line)) {
+        ParsedLine pl;
+        error_sink_at(diag, line.line_no);
+        if (parse_line_view(&line, &pl, scratch)) {
+            statements += pl.type != STMT_EMPTY;
+            first_pass_statement(&pl, scratch, &st, &IC, &DC, &data_seg);
+            if (!spill_statement(stmts, &pl)) break;
+        }
+        arena_reset(scratch);
+        if (data_seg.count >= DATA_FLUSH_WORDS && !flush_data(data, &data_seg))
+            break;
+    }
+    error_sink_at(diag, 0);
+    if (ms.failed) goto cleanup;
+    flush_data(data, &data_seg);
+    /* a failed spill write leaves the error flag of its file set */
+    if (!spill_done(stmts) || !spill_done(data))
+        goto cleanup;
+    first_pass_finish(&st, IC);
+    stats_end(&mark, PHASE_FIRST_PASS, arena->allocated + scratch->allocated);
+    stats_count(STAT_LINES, ms.line_no);
+    stats_count(STAT_STATEMENTS, statements);
+    if (get_error_count() != 0) {
+        print_error("First pass failed");
+        goto cleanup;
+    }
+
+    /* second pass: encode straight into the .ob */
+    base = strip_extension(from_stdin ? "stdin" : fname);
+    if (!base) goto cleanup;
+    obname = strcat_printf(base, ".ob");
+    if (!obname || !object_writer_open(&ow, obname, IC, DC, BASE_ADDRESS))
+        goto cleanup;
+
+    cpu.symtab = &st;
+    cpu.arena = scratch;
+    cpu.PC = 0;
+    stats_begin(&mark, arena->allocated + scratch->allocated);
+    rewind(stmts);
+    ParsedLine pl;
+    bool spilled = true;
+    while (spilled && read_statement(stmts, &pl, &text, &text_cap)) {
+        uint16_t words[MAX_INSTRUCTION_WORDS];
+        error_sink_at(diag, pl.line_number);
+        int count = second_pass_line(&pl, &cpu, words);
+        for (int w = 0; w < count; w++)
+            object_writer_put(&ow, words[w]);
+        cpu.PC += count;
+        spilled = spill_uses(exts, cpu.ext_uses);
+        cpu.ext_uses = NULL;
+        arena_reset(scratch);
+    }
+    stats_end(&mark, PHASE_SECOND_PASS, arena->allocated + scratch->allocated);
+    error_sink_at(diag, 0);
+    if (!spilled) {
+        print_system_error("write spill file");
+        goto cleanup;
+    }
+    /* a short read is not the end of the statements */
+    if (ferror(stmts) || !feof(stmts)) {
+        print_system_error("read spill file");
+        goto cleanup;
+    }
+    if (get_error_count() != 0) {
+        print_error("Second pass failed");
+        goto cleanup;
+    }
+    /* the code image is always IC words long */
+    stats_begin(&mark, 0);
+    for (int i = cpu.PC; i < IC; i++)
+        object_writer_put(&ow, 0);
+
+    rewind(data);
+    uint16_t block[DATA_FLUSH_WORDS];
+    size_t n;
+    int data_words = 0;
+    while ((n = fread(block, sizeof(uint16_t), DATA_FLUSH_WORDS, data)) > 0) {
+        for (size_t i = 0; i < n; i++)
+            object_writer_put(&ow, block[i]);
+        data_words += (int)n;
+    }
+    if (ferror(data)) {
+        print_system_error("read spill file");
+        goto cleanup;
+    }
+    if (data_words != DC) {
+        print_error("Data count mismatch");
+        goto cleanup;
+    }
+    if (!object_writer_close(&ow)) {
+        remove(obname);
+        goto cleanup;
+    }
+    stats_end(&mark, PHASE_WRITE_OB, 0);
+    stats_count(STAT_WORDS_EMITTED, IC + DC);
+
+    char *outname = strcat_printf(base, ".ent");
+    stats_begin(&mark, 0);
+    bool entries_ok = write_entries_file(outname, &st);
+    stats_end(&mark, PHASE_WRITE_ENT, 0);
+    free(outname);
+
+    outname = strcat_printf(base, ".ext");
+    stats_begin(&mark, 0);
+    ok = write_spilled_externals(outname, exts) && entries_ok;
+    stats_end(&mark, PHASE_WRITE_EXT, 0);
+    free(outname);
+
+cleanup:
+    /* a writer still open means the run stopped half way */
+    if (ow.f) {
+        object_writer_close(&ow);
+        remove(obname);
+    }
+    if (stmts) fclose(stmts);
+    if (data) fclose(data);
+    if (exts) fclose(exts);
+    free(base);
+    free(obname);
+    free(text);
+    free_data_segment(&data_seg);
+    free_symbol_table(&st);
+    free_macro_stream(&ms);
+    free_macro_table(&mt);
+    arena_reset(arena);
+    arena_reset(scratch);
+    if (!from_stdin) fclose(in);
+    return ok;
+}
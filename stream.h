@@ -0,0 +1,19 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include "arena.h"
+
+/*
+ * Bounded-memory assembly of `fname` ("-" reads standard input, and the
+ * outputs are then named stdin.ob/.ent/.ext).  The source is read one line
+ * at a time and macros are expanded as it arrives, so they must be defined
+ * before they are used.  Only the symbol and macro tables stay in memory;
+ * statements, data words and external uses are spilled to temporary files
+ * between the passes and the .ob is written as the second pass encodes.
+ * Symbols and macros are kept in `arena`; per-statement data uses `scratch`,
+ * which is reset after every line.  Both are reset before returning.
+ */
+bool assemble_stream(const char *fname, Arena *arena, Arena *scratch);
+
+#endif /* STREAM_H */
@@ -1,35 +1,121 @@
 // symbol_table.c
 #include "symbol_table.h"
 #include "error.h"  /* print_error */
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* initial number of index slots; grows by doubling */
+#define SYMBOL_MIN_SLOTS 64
+
+/* initialise an empty symbol table */
+void init_symbol_table(SymbolTable *table, Arena *arena) {
+    if (!table) return;
+    table->blocks = NULL;
+    table->block_cap = 0;
+    table->count = 0;
+    table->slots = NULL;
+    table->slot_mask = 0;
+    table->arena = arena;
+}
+
+/* FNV-1a */
+static uint32_t hash_name(const char *name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+/* Slot of `name`: the one holding it, or the empty slot where it would go */
+static int *find_slot(const SymbolTable *table, const char *name, uint32_t hash) {
+    uint32_t i = hash & table->slot_mask;
+    for (;;) {
+        int *slot = &table->slots[i];
+        if (*slot == 0) return slot;
+        const Symbol *sym = symbol_at(table, *slot - 1);
+        if (sym->hash == hash && strcmp(sym->name, name) == 0)
+            return slot;
+        i = (i + 1) & table->slot_mask;
+    }
+}
+
+/* Count a lookup that ended at `slot`: the probes are its distance from
+ * the home slot of `hash`, plus one */
+static void count_lookup(const SymbolTable *table, const int *slot, uint32_t hash) {
+    uint32_t at = (uint32_t)(slot - table->slots);
+    stats_count(STAT_SYMBOL_LOOKUPS, 1);
+    stats_count(STAT_SYMBOL_PROBES, ((at - hash) & table->slot_mask) + 1);
+}
+
+/* Double the index (or create it) and re-insert every symbol */
+static bool grow_index(SymbolTable *table) {
+    uint32_t nslots = table->slots ? (table->slot_mask + 1) * 2 : SYMBOL_MIN_SLOTS;
+    int *slots = arena_alloc(table->arena, sizeof(int) * nslots);
+    if (!slots) return false;
+    memset(slots, 0, sizeof(int) * nslots);
+    table->slots = slots;
+    table->slot_mask = nslots - 1;
+    for (int id = 0; id < table->count; id++) {
+        const Symbol *sym = symbol_at(table, id);
+        *find_slot(table, sym->name, sym->hash) = id + 1;
+    }
+    return true;
+}
+
+/* Storage for the next symbol id, adding a block when the last one is full */
+static Symbol *next_symbol(SymbolTable *table) {
+    int block = table->count / SYMBOL_BLOCK;
+    if (table->count % SYMBOL_BLOCK == 0) {
+        if (block >= table->block_cap) {
+            int cap = table->block_cap ? table->block_cap * 2 : 8;
+            Symbol **blocks = arena_alloc(table->arena, sizeof(Symbol*) * cap);
+            if (!blocks) return NULL;
+            if (table->block_cap)
+                memcpy(blocks, table->blocks, sizeof(Symbol*) * table->block_cap);
+            table->blocks = blocks;
+            table->block_cap = cap;
+        }
+        table->blocks[block] = arena_alloc(table->arena, sizeof(Symbol) * SYMBOL_BLOCK);
+        if (!table->blocks[block]) return NULL;
+    }
+    return &table->blocks[block][table->count % SYMBOL_BLOCK];
+}
+
 // Adds a new symbol to the table. Returns pointer to new symbol (or NULL if duplicate).
-Symbol* add_symbol(Symbol** table, const char* name, int address, SymbolType type) {
+Symbol* add_symbol(SymbolTable* table, const char* name, int address, SymbolType type) {
     if (!table || !name) return NULL;
-    // Check for duplicates
-    Symbol* existing = find_symbol(*table, name);
-    if (existing) return NULL; // Duplicate
-    Symbol* sym = (Symbol*)malloc(sizeof(Symbol));
+    /* keep the index at most half full */
+    if ((uint32_t)(table->count + 1) * 2 > table->slot_mask + 1 || !table->slots)
+        if (!grow_index(table)) return NULL;
+
+    char key[32];
+    strncpy(key, name, 31);
+    key[31] = '\0';
+    uint32_t hash = hash_name(key);
+    int *slot = find_slot(table, key, hash);
+    if (stats_enabled) count_lookup(table, slot, hash);
+    if (*slot) return NULL; // Duplicate
+
+    Symbol* sym = next_symbol(table);
     if (!sym) return NULL;
-    strncpy(sym->name, name, 31);
-    sym->name[31] = '\0';
+    memcpy(sym->name, key, sizeof(sym->name));
     sym->address = address;
     sym->type = type;
-    sym->next = *table;
-    *table = sym;
+    sym->hash = hash;
+    sym->id = table->count++;
+    *slot = sym->id + 1;
     return sym;
 }
 
 // Finds a symbol by name. Returns pointer if found, else NULL.
-Symbol* find_symbol(Symbol* table, const char* name) {
-    while (table) {
-        if (strcmp(table->name, name) == 0)
-            return table;
-        table = table->next;
-    }
-    return NULL;
+Symbol* find_symbol(const SymbolTable* table, const char* name) {
+    if (!table->count) return NULL;
+    uint32_t hash = hash_name(name);
+    const int *slot = find_slot(table, name, hash);
+    if (stats_enabled) count_lookup(table, slot, hash);
+    return *slot ? symbol_at(table, *slot - 1) : NULL;
 }
 
 /* Convenience wrapper for external users */
@@ -38,7 +124,7 @@ Symbol* lookup_symbol(SymbolTable* table, const char* name) {
 }
 
 // Updates the type of a symbol (e.g., for marking as entry or external).
-bool update_symbol_type(Symbol* table, const char* name, SymbolType new_type) {
+bool update_symbol_type(SymbolTable* table, const char* name, SymbolType new_type) {
     Symbol* sym = find_symbol(table, name);
     if (!sym) return false;
     if (sym->type == SYM_EXTERNAL && new_type == SYM_ENTRY) {
@@ -50,31 +136,27 @@ bool update_symbol_type(Symbol* table, const char* name, SymbolType new_type) {
 }
 
 // Prints all symbols (for debug)
-void print_symbol_table(Symbol* table) {
+void print_symbol_table(const SymbolTable* table) {
     printf("Symbol Table:\n");
     printf("%-20s %-8s %-6s\n", "Name", "Address", "Type");
-    while (table) {
+    for (int id = 0; id < table->count; id++) {
+        const Symbol* sym = symbol_at(table, id);
         const char* type_str =
-            table->type == SYM_CODE ? "code" :
-            table->type == SYM_DATA ? "data" :
-            table->type == SYM_ENTRY ? "entry" : "external";
-        printf("%-20s %-8d %-8s\n", table->name, table->address, type_str);
-        table = table->next;
+            sym->type == SYM_CODE ? "code" :
+            sym->type == SYM_DATA ? "data" :
+            sym->type == SYM_ENTRY ? "entry" : "external";
+        printf("%-20s %-8d %-8s\n", sym->name, sym->address, type_str);
     }
 }
 
-// Frees all memory of the table
-void free_symbol_table(Symbol* table) {
-    while (table) {
-        Symbol* next = table->next;
-        free(table);
-        table = next;
-    }
+// Empties the table; the storage is released together with the arena
+void free_symbol_table(SymbolTable* table) {
+    init_symbol_table(table, table->arena);
 }
 
-ExternalUse* add_external_use(ExternalUse **list, const char *name, int address) {
+ExternalUse* add_external_use(Arena *arena, ExternalUse **list, const char *name, int address) {
     if (!list || !name) return NULL;
-    ExternalUse *node = malloc(sizeof(ExternalUse));
+    ExternalUse *node = arena_alloc(arena, sizeof(ExternalUse));
     if (!node) return NULL;
     strncpy(node->name, name, 31);
     node->name[31] = '\0';
@@ -84,11 +166,3 @@ ExternalUse* add_external_use(ExternalUse **list, const char *name, int address)
     return node;
 }
 
-void free_external_uses(ExternalUse *list) {
-    while (list) {
-        ExternalUse *next = list->next;
-        free(list);
-        list = next;
-    }
-}
-
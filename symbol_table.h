@@ -4,6 +4,8 @@
 #define SYMBOL_TABLE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
 
 /* Base address for the assembled program in memory */
 #define BASE_ADDRESS 100
@@ -21,7 +23,8 @@ typedef struct Symbol {
     char name[32];
     int address;
     SymbolType type;
-    struct Symbol* next;
+    uint32_t hash;   /* hash of name, kept to skip most string compares */
+    int id;          /* position in definition order, 0-based; never changes */
 } Symbol;
 
 /* Linked-list node recording a single use of an external symbol */
@@ -31,17 +34,35 @@ typedef struct ExternalUse {
     struct ExternalUse *next;
 } ExternalUse;
 
+/* Symbols are stored in fixed blocks of this many, so a Symbol* stays
+ * valid while the table grows */
+#define SYMBOL_BLOCK 256
+
 /*
- * The symbol table is represented as a simple singly linked list.
- * We use a dummy head node (of type SymbolTable) whose 'next' pointer
- * points to the first real symbol.  This allows functions that modify
- * the list to receive a pointer to the head without needing a pointer
- * to a pointer in most call sites.
+ * Symbols live in contiguous blocks, in definition order, and are found
+ * through an open-addressing hash index (linear probing, at most half
+ * full).  Everything is allocated from the arena of the assembly that owns
+ * the table, so the whole table is released when that arena is reset.
  */
-typedef Symbol SymbolTable; /* alias for clarity (dummy head node) */
-
-/* initialise an empty symbol table (sets the head's fields to defaults) */
-void init_symbol_table(SymbolTable *table);
+typedef struct {
+    Symbol  **blocks;      /* symbol `id` is blocks[id / SYMBOL_BLOCK][id % SYMBOL_BLOCK] */
+    int       block_cap;
+    int       count;
+    int      *slots;       /* index: symbol id + 1, or 0 for an empty slot */
+    uint32_t  slot_mask;   /* slot count - 1; the slot count is a power of two */
+    Arena    *arena;       /* storage for the blocks and the index */
+} SymbolTable;
+
+/* Number of symbols, and the symbol with a given id (0 <= id < count) */
+static inline int symbol_count(const SymbolTable *table) {
+    return table->count;
+}
+static inline Symbol *symbol_at(const SymbolTable *table, int id) {
+    return &table->blocks[id / SYMBOL_BLOCK][id % SYMBOL_BLOCK];
+}
+
+/* initialise an empty symbol table whose nodes live in `arena` */
+void init_symbol_table(SymbolTable *table, Arena *arena);
 
 /* Add a label (code or data) to the table.  Returns false on duplicate. */
 bool add_label(SymbolTable *table, const char *name, int address, bool is_data);
@@ -56,28 +77,25 @@ void relocate_data_symbols(SymbolTable *table, int offset);
 void relocate_all_symbols(SymbolTable *table, int offset);
 
 // Adds a new symbol to the table. Returns pointer to new symbol (or NULL if duplicate).
-Symbol* add_symbol(Symbol** table, const char* name, int address, SymbolType type);
+Symbol* add_symbol(SymbolTable* table, const char* name, int address, SymbolType type);
 
 // Finds a symbol by name. Returns pointer if found, else NULL.
-Symbol* find_symbol(Symbol* table, const char* name);
+Symbol* find_symbol(const SymbolTable* table, const char* name);
 
 /* Convenience wrapper to find a symbol by name */
 Symbol* lookup_symbol(SymbolTable* table, const char* name);
 
 // Updates the type of a symbol (e.g., for marking as entry or external).
-bool update_symbol_type(Symbol* table, const char* name, SymbolType new_type);
+bool update_symbol_type(SymbolTable* table, const char* name, SymbolType new_type);
 
 // Prints all symbols (for debug)
-void print_symbol_table(Symbol* table);
-
-// Frees all memory of the table
-void free_symbol_table(Symbol* table);
+void print_symbol_table(const SymbolTable* table);
 
-/* Records a use of an external symbol at 'address' */
-ExternalUse* add_external_use(ExternalUse **list, const char *name, int address);
+// Empties the table (the nodes belong to its arena)
+void free_symbol_table(SymbolTable* table);
 
-/* Frees the list of external symbol uses */
-void free_external_uses(ExternalUse *list);
+/* Records a use of an external symbol at 'address'; the node comes from `arena` */
+ExternalUse* add_external_use(Arena *arena, ExternalUse **list, const char *name, int address);
 
 #endif // SYMBOL_TABLE_H
 
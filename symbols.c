@@ -5,15 +5,6 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
-/* initialise an empty symbol table */
-void init_symbol_table(SymbolTable *table) {
-    if (!table) return;
-    table->name[0] = '\0';
-    table->address = 0;
-    table->type = SYM_CODE; /* default, not really used for head */
-    table->next = NULL;
-}
-
 /*
  * Add a new label (code or data) to the symbol table.
  * Returns true on success, false if label already exists.
@@ -21,8 +12,8 @@ void init_symbol_table(SymbolTable *table) {
 bool add_label(SymbolTable *table, const char *name, int address, bool is_data) {
     if (!table || !name) return false;
     SymbolType type = is_data ? SYM_DATA : SYM_CODE;
-    /* add_symbol checks for duplicates; we use the list after the dummy head */
-    Symbol *sym = add_symbol(&table->next, name, address, type);
+    /* add_symbol checks for duplicates */
+    Symbol *sym = add_symbol(table, name, address, type);
     if (!sym) {
         print_error("Duplicate symbol: %s", name);
         return false;
@@ -46,7 +37,7 @@ bool add_label_external(SymbolTable *table, const char *name) {
             print_error("Invalid label name");
         return false;
     }
-    Symbol *sym = add_symbol(&table->next, buf, 0, SYM_EXTERNAL);
+    Symbol *sym = add_symbol(table, buf, 0, SYM_EXTERNAL);
     if (!sym) {
         print_error("Duplicate symbol: %s", buf);
         return false;
@@ -59,21 +50,17 @@ bool add_label_external(SymbolTable *table, const char *name) {
  */
 void relocate_data_symbols(SymbolTable *table, int offset) {
     if (!table) return;
-    Symbol *curr = table->next;
-    while (curr) {
-        if (curr->type == SYM_DATA)
-            curr->address += offset;
-        curr = curr->next;
+    for (int id = 0; id < symbol_count(table); id++) {
+        Symbol *sym = symbol_at(table, id);
+        if (sym->type == SYM_DATA)
+            sym->address += offset;
     }
 }
 
 /* Relocate all symbols (code and data) by adding 'offset'. */
 void relocate_all_symbols(SymbolTable *table, int offset) {
     if (!table) return;
-    Symbol *curr = table->next;
-    while (curr) {
-        curr->address += offset;
-        curr = curr->next;
-    }
+    for (int id = 0; id < symbol_count(table); id++)
+        symbol_at(table, id)->address += offset;
 }
 
@@ -0,0 +1,44 @@
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+int main(void) {
+    Arena arena;
+    arena_init(&arena, 128);
+
+    /* allocations are aligned and do not overlap */
+    char *a = arena_alloc(&arena, 3);
+    char *b = arena_alloc(&arena, 5);
+    assert(a && b && a != b);
+    assert(((uintptr_t)b % 16) == 0);
+
+    char *s = arena_strndup(&arena, "label: mov", 5);
+    assert(strcmp(s, "label") == 0);
+
+    /* larger than a chunk: gets a chunk of its own */
+    char *big = arena_alloc(&arena, 1000);
+    assert(big);
+    memset(big, 'x', 1000);
+
+    /* reset rewinds to the first chunk and keeps the rest for reuse */
+    ArenaChunk *first = arena.first;
+    ArenaChunk *second = first->next;
+    arena_reset(&arena);
+    assert(arena.first == first && arena.current == first);
+    assert(arena_alloc(&arena, 16) == a);
+    arena_alloc(&arena, 200);
+    assert(arena.current == second);
+
+    /* the running total survives resets and moves with adopted chunks */
+    assert(arena.allocated == 3 + 5 + 6 + 1000 + 16 + 200);
+    Arena other;
+    arena_init(&other, 0);
+    arena_alloc(&other, 10);
+    arena_adopt(&arena, &other);
+    assert(arena.allocated == 1240 && other.allocated == 0);
+
+    arena_free(&arena);
+    assert(arena.first == NULL);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "assemble.h"
+#include "output.h"
+#include "utils.h"
+
+#define DIR "test_cache_tmp"
+#define BASE "test_cache_tmp_prog"
+#define OTHER "test_cache_tmp_other"
+
+static const char *const kinds[] = { ".ob", ".ent", ".ext" };
+
+static const char prog[] =
+    ".extern EXTF\n"
+    ".entry MAIN\n"
+    "MAIN: mov r1, r2\n"
+    "      jsr EXTF\n"
+    "      stop\n"
+    "K:    .data 7,-1\n";
+
+static const char other[] =
+    "LOOP: inc r3\n"
+    "      bne LOOP\n"
+    "      stop\n";
+
+static Arena arena, scratch;
+
+static void write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    assert(f && fputs(text, f) >= 0);
+    fclose(f);
+}
+
+/* Whole contents of a file */
+static char *slurp(const char *path, long *size) {
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    char *buf = malloc((size_t)*size + 1);
+    assert(buf && fread(buf, 1, (size_t)*size, f) == (size_t)*size);
+    fclose(f);
+    return buf;
+}
+
+static char *path_of(const char *base, const char *kind) {
+    char *path = strcat_printf(base, kind);
+    assert(path);
+    return path;
+}
+
+static void remove_outputs(const char *base) {
+    for (int k = 0; k < 3; k++) {
+        char *path = path_of(base, kinds[k]);
+        remove(path);
+        free(path);
+    }
+}
+
+/* What the driver does for one file: restore it, or assemble and store
+ * it.  Returns true on a hit; the key is left in `key`. */
+static bool assemble_cached(const char *base, char key[CACHE_KEY_LEN + 1]) {
+    char *fname = path_of(base, ".as");
+    SourceBuffer src;
+    assert(load_source(fname, &src));
+    free(fname);
+    cache_key(src.data, src.size, key);
+    if (cache_restore(key, base)) {
+        free_source(&src);
+        return true;
+    }
+
+    Assembly as;
+    assert(assemble_lines(src.lines, src.line_count, &arena, &scratch, &as));
+    free_source(&src);
+    char *out = path_of(base, ".ob");
+    assert(write_object_file(out, as.code, as.code_count, as.data, as.data_count, BASE_ADDRESS));
+    free(out);
+    out = path_of(base, ".ent");
+    assert(write_entries_file(out, &as.symtab));
+    free(out);
+    out = path_of(base, ".ext");
+    assert(write_externals_file(out, as.ext_uses));
+    free(out);
+    cache_store(key, base);
+    arena_reset(&arena);
+    arena_reset(&scratch);
+    return false;
+}
+
+static bool entry_exists(const char *key) {
+    char path[sizeof(DIR) + CACHE_KEY_LEN + 8];
+    snprintf(path, sizeof(path), "%s/%s.ob", DIR, key);
+    return access(path, F_OK) == 0;
+}
+
+static void remove_entry(const char *key) {
+    char path[sizeof(DIR) + CACHE_KEY_LEN + 8];
+    for (int k = 0; k < 3; k++) {
+        snprintf(path, sizeof(path), "%s/%s%s", DIR, key, kinds[k]);
+        remove(path);
+    }
+}
+
+int main(void) {
+    arena_init(&arena, 0);
+    arena_init(&scratch, 0);
+    write_file(BASE ".as", prog);
+    write_file(OTHER ".as", other);
+    char key[CACHE_KEY_LEN + 1], other_key[CACHE_KEY_LEN + 1];
+
+    /* the second run is a hit that recreates the same bytes */
+    assert(cache_configure(DIR, CACHE_DEFAULT_LIMIT));
+    assert(!assemble_cached(BASE, key));
+    char *first[3];
+    long first_size[3];
+    for (int k = 0; k < 3; k++) {
+        char *path = path_of(BASE, kinds[k]);
+        first[k] = slurp(path, &first_size[k]);
+        free(path);
+    }
+    remove_outputs(BASE);
+    assert(assemble_cached(BASE, key));
+    for (int k = 0; k < 3; k++) {
+        long size;
+        char *path = path_of(BASE, kinds[k]);
+        char *again = slurp(path, &size);
+        assert(size == first_size[k] && memcmp(again, first[k], (size_t)size) == 0);
+        free(again);
+        free(path);
+        free(first[k]);
+    }
+
+    FILE *stats = tmpfile();
+    assert(stats);
+    cache_finish(stats);
+    char line[128];
+    rewind(stats);
+    assert(fgets(line, sizeof(line), stats));
+    assert(strcmp(line, "cache: 1 hits, 1 misses, 0 evicted\n") == 0);
+    fclose(stats);
+
+    /* a limit that holds only one entry keeps the most recently used */
+    assert(cache_configure(DIR, CACHE_DEFAULT_LIMIT));
+    assert(!assemble_cached(OTHER, other_key));
+    char old[sizeof(DIR) + CACHE_KEY_LEN + 8];
+    snprintf(old, sizeof(old), "%s/%s.ob", DIR, key);
+    /* back-date the first entry so the order does not hang on timestamp resolution */
+    struct timespec times[2] = { { 1, 0 }, { 1, 0 } };
+    assert(utimensat(AT_FDCWD, old, times, 0) == 0);
+    struct stat st;
+    long long other_bytes = 0;
+    for (int k = 0; k < 3; k++) {
+        char *path = path_of(OTHER, kinds[k]);
+        if (stat(path, &st) == 0) other_bytes += st.st_size;
+        free(path);
+    }
+    assert(cache_configure(DIR, other_bytes));
+    cache_finish(NULL);
+    assert(!entry_exists(key) && entry_exists(other_key));
+
+    remove_entry(other_key);
+    remove_outputs(BASE);
+    remove_outputs(OTHER);
+    remove(BASE ".as");
+    remove(OTHER ".as");
+    rmdir(DIR);
+    arena_free(&arena);
+    arena_free(&scratch);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cassembler.h"
+
+static int diagnostics;
+/* the first diagnostic of a run; its strings die with the callback */
+static AsmSeverity first_severity;
+static int first_line;
+static char first_code[64], first_message[128];
+
+static void count_diagnostic(void *user, const AsmDiagnostic *diag) {
+    assert(user == &diagnostics);
+    assert(diag->message[strlen(diag->message) - 1] != '\n');
+    if (diagnostics++ == 0) {
+        first_severity = diag->severity;
+        first_line = diag->line;
+        snprintf(first_code, sizeof(first_code), "%s", diag->code);
+        snprintf(first_message, sizeof(first_message), "%s", diag->message);
+    }
+}
+
+static const char good[] =
+    ".extern EXTF\n"
+    ".entry MAIN\n"
+    "MAIN: mov r1, r2\n"
+    "      jsr EXTF\n"
+    "      stop\n"
+    "K:    .data 7,-1\n";
+
+/* every addressing mode; the source operand has blanks around it */
+static const char modes[] =
+    ".extern EXTF\n"
+    "MAIN: mov  M[r1][r2] , EXTF\n"
+    "      prn #-3\n"
+    "      stop\n"
+    "M:    .mat 1,1, 9\n";
+
+static const char bad[] =
+    "MAIN: jmp NOWHERE\n"
+    "      stop\n";
+
+int main(void) {
+    Assembler *as = assembler_new(count_diagnostic, &diagnostics);
+    AsmResult r;
+    assert(as);
+
+    /* the source is not NUL-terminated: the length decides */
+    assert(assembler_assemble(as, good, sizeof(good) - 1, &r));
+    assert(r.error_count == 0 && diagnostics == 0);
+    assert(r.base_address == 100);
+    assert(r.code_count == 5 && r.data_count == 2);
+    assert(r.data[0] == 7 && r.data[1] == (uint16_t)-1);
+    assert(r.entry_count == 1);
+    assert(strcmp(r.entries[0].name, "MAIN") == 0 && r.entries[0].address == 100);
+    assert(r.external_count == 1);
+    assert(strcmp(r.externals[0].name, "EXTF") == 0 && r.externals[0].address == 102);
+
+    /* operands are decoded once; only label addresses are filled in later */
+    assert(assembler_assemble(as, modes, sizeof(modes) - 1, &r));
+    assert(r.code_count == 7 && diagnostics == 0);
+    assert(r.code[0] == (0 << 12 | 3 << 9 | 1 << 6 | 1 << 3));
+    assert(r.code[1] == 107 && r.code[2] == (1 << 3 | 2));
+    assert(r.code[4] == (13 << 12) && r.code[5] == (uint16_t)-3);
+    assert(r.external_count == 1 && r.externals[0].address == 103);
+
+    /* initializer lists have no length limit */
+    static char table[16384];
+    int n = sprintf(table, "T: .data 0");
+    for (int i = 1; i < 1000; i++) n += sprintf(table + n, ", %d", i - 500);
+    n += sprintf(table + n, "\nU: .mat 20,20");
+    for (int i = 0; i < 400; i++) n += sprintf(table + n, ",%d", i);
+    n += sprintf(table + n, "\nstop\n");
+    assert(assembler_assemble(as, table, (size_t)n, &r));
+    assert(r.data_count == 1400 && diagnostics == 0);
+    assert(r.data[999] == 499 && r.data[1] == (uint16_t)-499);
+    assert(r.data[1000] == 0 && r.data[1399] == 399);
+
+    /* a large file is parsed and encoded by several threads, with the
+     * same result */
+    size_t big_cap = 4 << 20, big_len = 0;
+    char *big = malloc(big_cap);
+    assert(big);
+    big_len += sprintf(big, ".extern EXTF\n.entry L9\n.entry T79999\n");
+    for (int i = 0; i < 80000; i++) {
+        if (i % 100 == 99)
+            big_len += sprintf(big + big_len, "T%d: .data %d, -1\n", i, i / 10);
+        else
+            big_len += sprintf(big + big_len, i % 5 ? " add #%d, L%d\n" : "L%d: jsr EXTF\n",
+                               i % 5 ? i % 1000 : i / 5, i % 5 ? (i * 7 % 80000) / 5 : 0);
+    }
+    big_len += sprintf(big + big_len, " stop\n");
+    setenv("ASSEMBLER_THREADS", "1", 1);
+    assert(assembler_assemble(as, big, big_len, &r));
+    int serial_count = r.code_count, serial_ext = r.external_count;
+    uint16_t *serial = malloc(sizeof(uint16_t) * serial_count);
+    assert(serial);
+    memcpy(serial, r.code, sizeof(uint16_t) * serial_count);
+    int last_ext = r.externals[serial_ext - 1].address;
+    int data_entry = r.entries[0].address;
+    assert(r.data_count == 1600 && r.data[1598] == 7999);
+    setenv("ASSEMBLER_THREADS", "4", 1);
+    assert(assembler_assemble(as, big, big_len, &r));
+    assert(r.code_count == serial_count && diagnostics == 0);
+    assert(memcmp(r.code, serial, sizeof(uint16_t) * serial_count) == 0);
+    assert(r.external_count == serial_ext && r.externals[serial_ext - 1].address == last_ext);
+    assert(r.entry_count == 2 && r.entries[0].address == data_entry);
+    assert(r.data_count == 1600 && r.data[1598] == 7999 && r.data[1599] == (uint16_t)-1);
+    unsetenv("ASSEMBLER_THREADS");
+    free(serial);
+    free(big);
+
+    /* errors come through the callback and leave an empty result */
+    assert(!assembler_assemble(as, bad, sizeof(bad) - 1, &r));
+    assert(r.error_count > 0 && diagnostics == r.error_count);
+    assert(r.code == NULL && r.code_count == 0 && r.entry_count == 0);
+    /* each one names its line and a stable code */
+    assert(first_severity == ASM_ERROR && first_line == 1);
+    assert(strcmp(first_code, "unknown-label") == 0);
+    assert(strcmp(first_message, "Unknown label: NOWHERE") == 0);
+
+    /* the same context can be used again */
+    diagnostics = 0;
+    assert(assembler_assemble(as, good, sizeof(good) - 1, &r));
+    assert(r.code_count == 5 && diagnostics == 0);
+
+    assembler_free(as);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+
+static char *render(ErrorSink *sink) {
+    size_t len;
+    char *text = error_sink_render(sink, &len);
+    assert(text && strlen(text) == len);
+    return text;
+}
+
+int main(void) {
+    ErrorSink sink;
+    error_sink_init(&sink);
+    error_sink_configure(&sink, "prog.as", NULL);
+    error_bind_sink(&sink);
+
+    /* records come out by line, those without one last, ties in order */
+    error_sink_at(&sink, 12);
+    print_error("Unknown label: %s", "LOOP");
+    error_sink_at(&sink, 0);
+    print_error("Second pass failed");
+    error_sink_at(&sink, 3);
+    print_error("Invalid number: %s", "x");
+    print_error("Invalid number: %s", "y");
+    assert(get_error_count() == 4 && sink.record_count == 4);
+    char *text = render(&sink);
+    assert(strcmp(text, "prog.as:3: Error: Invalid number: x\n"
+                        "prog.as:3: Error: Invalid number: y\n"
+                        "prog.as:12: Error: Unknown label: LOOP\n"
+                        "prog.as: Error: Second pass failed\n") == 0);
+    free(text);
+    assert(sink.record_count == 0);
+
+    /* JSON lines carry the code derived from the message format */
+    sink.format = DIAG_JSON;
+    error_sink_at(&sink, 7);
+    print_error("Macro %s expects %d parameters but got %d", "m\"q", 1, 2);
+    text = render(&sink);
+    assert(strcmp(text, "{\"severity\":\"error\",\"file\":\"prog.as\",\"line\":7,"
+                        "\"code\":\"macro-expects-parameters-but-got\","
+                        "\"message\":\"Macro m\\\"q expects 1 parameters but got 2\"}\n") == 0);
+    free(text);
+
+    /* a fatal error unwinds to the recovery point under its own code */
+    jmp_buf recover;
+    sink.recover = &recover;
+    error_sink_at(&sink, 0);
+    if (setjmp(recover) == 0) {
+        error_unwind("Memory allocation failed");
+        assert(!"error_unwind returned");
+    }
+    sink.recover = NULL;
+    text = render(&sink);
+    assert(strcmp(text, "{\"severity\":\"error\",\"file\":\"prog.as\",\"line\":null,"
+                        "\"code\":\"fatal\",\"message\":\"Memory allocation failed\"}\n") == 0);
+    free(text);
+
+    /* past the limit errors are counted but not kept */
+    sink.format = DIAG_TEXT;
+    sink.count = 0;
+    sink.max_errors = 2;
+    for (int i = 0; i < 5; i++) {
+        error_sink_at(&sink, i + 1);
+        assert(!error_sink_full(&sink) || i >= 2);
+        print_error("Duplicate symbol: L%d", i);
+    }
+    assert(error_sink_full(&sink) && get_error_count() == 5 && sink.record_count == 2);
+
+    error_bind_sink(NULL);
+    error_sink_free(&sink);
+    return 0;
+}
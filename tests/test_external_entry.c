@@ -3,22 +3,27 @@
 #include "second_pass.h"
 #include "symbol_table.h"
 #include "error.h"
+#include "arena.h"
 
 /* Stub for encode_instruction to satisfy linker */
-int encode_instruction(const ParsedLine *pl, CPUState *cpu, uint16_t out_words[3]) {
+int encode_instruction(const ParsedLine *pl, CPUState *cpu, uint16_t out_words[MAX_INSTRUCTION_WORDS]) {
     (void)pl; (void)cpu; (void)out_words;
     return 0;
 }
 
 int main(void) {
-    Symbol *symtab = NULL;
+    Arena arena;
+    arena_init(&arena, 0);
+    SymbolTable symtab;
+    init_symbol_table(&symtab, &arena);
     add_symbol(&symtab, "EXTSYM", 0, SYM_EXTERNAL);
 
     CPUState cpu = {0};
     uint16_t memory[1] = {0};
     cpu.memory = memory;
     cpu.PC = 0;
-    cpu.symtab = symtab;
+    cpu.symtab = &symtab;
+    cpu.arena = &arena;
     cpu.ext_uses = NULL;
 
     ParsedLine line = {0};
@@ -31,5 +36,6 @@ int main(void) {
     bool ok = second_pass(lines, 1, &cpu);
     assert(!ok);
     assert(get_error_count() == 2);
+    arena_free(&arena);
     return 0;
 }
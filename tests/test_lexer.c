@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "lexer.h"
+#include "parser.h"
+
+static ParsedLine parse(const char *s, Arena *arena) {
+    ParsedLine pl;
+    assert(parse_line(s, (int)strlen(s), &pl, 1, arena));
+    return pl;
+}
+
+int main(void) {
+    Arena arena;
+    arena_init(&arena, 0);
+
+    /* tokens are views into the line; a comment ends the stream */
+    const char *line = "  LOOP: mov r1,#-5 ; done: yes";
+    Lexer lx;
+    Token tok;
+    lex_init(&lx, line, (int)strlen(line));
+    const TokenKind kinds[] = { TOK_WORD, TOK_COLON, TOK_WORD, TOK_WORD, TOK_COMMA, TOK_WORD };
+    const int offs[] = { 2, 6, 8, 12, 14, 15 };
+    const int lens[] = { 4, 1, 3, 2, 1, 3 };
+    for (int i = 0; i < 6; i++) {
+        assert(lex_next(&lx, &tok));
+        assert(tok.kind == kinds[i] && tok.off == offs[i] && tok.len == lens[i]);
+    }
+    assert(!lex_next(&lx, &tok));
+
+    /* lines of a scan block or more take the vectorised path */
+    char longline[200];
+    int n = 0;
+    for (int w = 0; w < 30; w++)
+        n += sprintf(longline + n, w % 3 ? "w%d, " : "word_%d:", w);
+    lex_init(&lx, longline, n);
+    int words = 0, punct = 0, last_end = 0;
+    while (lex_next(&lx, &tok)) {
+        assert(tok.off >= last_end);
+        if (tok.kind == TOK_WORD) {
+            assert(longline[tok.off] == 'w' && tok.len >= 2);
+            assert(strchr(" ,:", longline[tok.off + tok.len]) || tok.off + tok.len == n);
+            words++;
+        } else {
+            assert(tok.len == 1);
+            punct++;
+        }
+        last_end = tok.off + tok.len;
+    }
+    assert(words == 30 && punct == 30);
+
+    /* bytes outside ASCII are never blanks or letters */
+    assert(!is_space_char((char)0xa0) && !(char_class[0xe9] & CC_ALPHA));
+    assert(lex_word_len("abcdefghijkl x", 0, 14, 9) == 9);
+
+    ParsedLine pl = parse("MAIN:   mov r3 , LENGTH   ; comment", &arena);
+    assert(pl.type == STMT_INSTRUCTION && pl.has_label);
+    assert(strcmp(pl.label, "MAIN") == 0 && strcmp(pl.opcode, "mov") == 0);
+    assert(strcmp(pl.operands_raw, "r3 , LENGTH") == 0);
+
+    pl = parse("\t.data 6,-9, 15", &arena);
+    assert(pl.type == STMT_DIRECTIVE && pl.dir_type == DIR_DATA);
+    assert(strcmp(pl.directive_args, "6,-9, 15") == 0);
+
+    /* the name may follow the dot after blanks, as sscanf read it */
+    pl = parse(". entry X", &arena);
+    assert(pl.type == STMT_DIRECTIVE && pl.dir_type == DIR_ENTRY);
+    assert(strcmp(pl.directive_args, "X") == 0);
+    pl = parse(".  data 5, 6", &arena);
+    assert(pl.type == STMT_DIRECTIVE && pl.dir_type == DIR_DATA);
+    assert(strcmp(pl.directive_args, "5, 6") == 0);
+
+    /* opcodes are cut at MAX_OPCODE_LEN - 1 bytes */
+    pl = parse("abcdefghijk r1", &arena);
+    assert(strcmp(pl.opcode, "abcdefghi") == 0 && strcmp(pl.operands_raw, "jk r1") == 0);
+
+    pl = parse("END:", &arena);
+    assert(pl.type == STMT_LABEL_ONLY && strcmp(pl.label, "END") == 0);
+    pl = parse("   ; only a comment", &arena);
+    assert(pl.type == STMT_EMPTY);
+
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "macro.h"
+#include "parser.h"
+#include "error.h"
+
+#define MACROS 200
+#define LINES  (MACROS * 3 + 2)
+
+static char text[LINES][160];
+static LineView lines[LINES];
+
+static void set_line(int i) {
+    lines[i].ptr = text[i];
+    lines[i].len = (int)strlen(text[i]);
+    lines[i].line_no = i + 1;
+}
+
+int main(void) {
+    Arena arena;
+    MacroTable mt;
+    arena_init(&arena, 0);
+    init_macro_table(&mt, &arena);
+
+    /* more macros, parameters and name length than the old fixed table */
+    int n = 0;
+    for (int m = 0; m < MACROS; m++) {
+        snprintf(text[n++], sizeof(text[0]),
+                 "MACRO a_rather_long_generated_macro_name_%d a,b,c,d,e,f,g,h,i,j", m);
+        snprintf(text[n++], sizeof(text[0]), "mov %%a%%, %%j%%");
+        snprintf(text[n++], sizeof(text[0]), "ENDM");
+    }
+    snprintf(text[n++], sizeof(text[0]),
+             "a_rather_long_generated_macro_name_123 r1,2,3,4,5,6,7,8,9,r2");
+    snprintf(text[n++], sizeof(text[0]), "a_rather_long_generated_macro_name_7 r1");
+    for (int i = 0; i < n; i++) set_line(i);
+
+    assert(scan_macros(lines, n, &mt));
+    assert(mt.count == MACROS);
+
+    int out_n;
+    LineView *out = expand_macros(lines, n, &out_n, &mt);
+    assert(out_n == 2);
+    /* the body line was parsed when the macro was defined */
+    assert(out[0].parsed && out[0].line_no == n - 1);
+    ParsedLine pl;
+    assert(parse_line_view(&out[0], &pl, &arena));
+    assert(pl.type == STMT_INSTRUCTION && strcmp(pl.opcode, "mov") == 0);
+    assert(strcmp(pl.operands_raw, "r1, r2") == 0 && pl.line_number == n - 1);
+    /* a wrong argument count is reported and the line passed through */
+    assert(get_error_count() == 1);
+    assert(out[1].ptr == lines[n - 1].ptr);
+    free(out);
+
+    /* slots may be adjacent or share a prefix; other '%' text is literal */
+    n = 0;
+    snprintf(text[n++], sizeof(text[0]), "MACRO glue x,xy");
+    snprintf(text[n++], sizeof(text[0]), "%%xy%%%%x%% %% %%z%% %%x");
+    snprintf(text[n++], sizeof(text[0]), "ENDM");
+    snprintf(text[n++], sizeof(text[0]), "glue A, Bc");
+    for (int i = 0; i < n; i++) set_line(i);
+    assert(scan_macros(lines, n, &mt));
+    out = expand_macros(lines, n, &out_n, &mt);
+    assert(out_n == 1);
+    assert(!out[0].parsed);
+    assert(out[0].len == 12 && memcmp(out[0].ptr, "BcA % %z% %x", 12) == 0);
+    free(out);
+
+    /* only operands are filled in; an argument that would change how the
+     * line parses sends it through the parser instead */
+    n = 0;
+    snprintf(text[n++], sizeof(text[0]), "MACRO fill v,w");
+    snprintf(text[n++], sizeof(text[0]), "HERE: .data %%v%% ,%%w%% ; %%v%%");
+    snprintf(text[n++], sizeof(text[0]), "ENDM");
+    snprintf(text[n++], sizeof(text[0]), "fill 3 , 7");
+    snprintf(text[n++], sizeof(text[0]), "fill 1, x:y");
+    for (int i = 0; i < n; i++) set_line(i);
+    assert(scan_macros(lines, n, &mt));
+    out = expand_macros(lines, n, &out_n, &mt);
+    assert(out_n == 2);
+    assert(out[0].parsed);
+    assert(parse_line_view(&out[0], &pl, &arena));
+    assert(pl.type == STMT_DIRECTIVE && pl.dir_type == DIR_DATA && pl.has_label);
+    assert(strcmp(pl.label, "HERE") == 0 && strcmp(pl.directive_args, "3 ,7") == 0);
+    assert(!out[1].parsed);
+    assert(out[1].len == 22 && memcmp(out[1].ptr, "HERE: .data 1 ,x:y ; 1", 22) == 0);
+    free(out);
+
+    free_macro_table(&mt);
+    arena_free(&arena);
+    return 0;
+}
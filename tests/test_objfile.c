@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "objfile.h"
+#include "utils.h"
+
+#define BASE "test_objfile_tmp"
+
+/* Whole contents of a file */
+static char *slurp(const char *path, long *size) {
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    char *buf = malloc((size_t)*size + 1);
+    assert(buf && fread(buf, 1, (size_t)*size, f) == (size_t)*size);
+    fclose(f);
+    return buf;
+}
+
+int main(void) {
+    const uint16_t code[] = { 0x0648, 107, 10, 0, 0xD000, 0xFFFD, 0xF000 };
+    const uint16_t data[] = { 9, 0xFFFF };
+    const ObjName entries[] = { { "MAIN", 100 }, { "M", 107 } };
+    const ObjName externals[] = { { "EXTF", 103 } };
+    ObjContents c = {
+        .base_address = 100,
+        .code = code, .code_count = 7,
+        .data = data, .data_count = 2,
+        .entries = entries, .entry_count = 2,
+        .externals = externals, .external_count = 1,
+    };
+    assert(write_binary_object(BASE ".obj", &c));
+
+    /* the loader hands out pointers into the file as written */
+    ObjectImage img;
+    assert(objfile_load(BASE ".obj", &img));
+    assert(img.base_address == 100 && img.code_count == 7 && img.data_count == 2);
+    assert(memcmp(img.code, code, sizeof(code)) == 0);
+    assert(memcmp(img.data, data, sizeof(data)) == 0);
+    assert(img.entry_count == 2 && img.external_count == 1);
+    assert(strcmp(obj_symbol_name(&img, &img.entries[1]), "M") == 0);
+    assert(img.entries[1].address == 107);
+    assert(strcmp(obj_symbol_name(&img, &img.externals[0]), "EXTF") == 0);
+    objfile_unload(&img);
+
+    /* text and back gives the same bytes */
+    long size, size2;
+    char *bin = slurp(BASE ".obj", &size);
+    assert(objfile_to_text(BASE));
+    char *ob = slurp(BASE ".ob", &size2);
+    assert(strncmp(ob, "7 2\n00001210 00121020\n00001211 00001223\n", 40) == 0);
+    free(ob);
+    remove(BASE ".obj");
+    assert(objfile_from_text(BASE));
+    char *bin2 = slurp(BASE ".obj", &size2);
+    assert(size == size2 && memcmp(bin, bin2, (size_t)size) == 0);
+    free(bin2);
+
+    /* a truncated file is rejected rather than mapped */
+    FILE *f = fopen(BASE ".obj", "wb");
+    assert(f && fwrite(bin, 1, (size_t)size - 3, f) == (size_t)size - 3);
+    fclose(f);
+    assert(!objfile_load(BASE ".obj", &img) && img.map == NULL);
+    free(bin);
+
+    remove(BASE ".obj");
+    remove(BASE ".ob");
+    remove(BASE ".ent");
+    remove(BASE ".ext");
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include <assert.h>
 #include "utils.h"
+#include "keywords.h"
+#include "parser.h"
 
 int main(void) {
     assert(is_reserved_word("mov"));
@@ -7,6 +9,21 @@ int main(void) {
     assert(is_reserved_word("data"));
     assert(!is_reserved_word("mylabel"));
 
+    /* case is ignored; near misses are not keywords */
+    assert(is_reserved_word("MoV"));
+    assert(is_reserved_word("EXTERN"));
+    assert(!is_reserved_word("r8"));
+    assert(!is_reserved_word("movx"));
+    assert(!is_reserved_word("mo"));
+    assert(!is_reserved_word(""));
+
+    Keyword kw = keyword_lookup("STOP r1", 4);
+    assert(kw.kind == KW_OPCODE && kw.value == 15);
+    kw = keyword_lookup_str("String");
+    assert(kw.kind == KW_DIRECTIVE && kw.value == DIR_STRING);
+    kw = keyword_lookup_str("R3");
+    assert(kw.kind == KW_REGISTER && kw.value == 3);
+
     assert(!is_valid_label("mov"));
     assert(!is_valid_label("r7"));
     assert(is_valid_label("my_label"));
@@ -0,0 +1,42 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+
+/* What every kernel must agree with */
+static uint32_t reference(const char *p, int n, unsigned set) {
+    static const char *const members[] = {
+        "\n", ";", ",", ":", "\"", "[", "]", " \t\n\v\f\r",
+    };
+    uint32_t mask = 0;
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < 9; c++) {
+            if (!(set & (1u << c))) continue;
+            if (c == 8 ? p[i] == '\0' : strchr(members[c], p[i]) != NULL && p[i] != '\0')
+                mask |= (uint32_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+int main(void) {
+    static const char *const kernels[] = { "scalar", "sse2", "avx2" };
+    /* mostly the interesting bytes, with some high and control ones */
+    static const char alphabet[] = "\n;,:\"[] \t\v\f\rab09\x80\xff\x01";
+    char block[SCAN_BLOCK];
+    srand(1);
+    for (int k = 0; k < 3; k++) {
+        if (!scan_set_kernel(kernels[k])) continue;
+        for (int round = 0; round < 20000; round++) {
+            for (int i = 0; i < SCAN_BLOCK; i++)
+                block[i] = round % 7 == 0 ? (char)(rand() & 0xff)
+                                          : alphabet[rand() % (sizeof(alphabet) - 1)];
+            unsigned set = (unsigned)rand() & 0x1ff;
+            assert(scan_block(block, set) == reference(block, SCAN_BLOCK, set));
+            int n = rand() % SCAN_BLOCK;
+            assert(scan_tail(block, n, set) == reference(block, n, set));
+        }
+    }
+    assert(scan_first(0x8) == 3);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include <assert.h>
+#include <string.h>
+#include "sha256.h"
+
+/* Hash `len` bytes of `msg`, fed in pieces of `step` bytes */
+static void hex_digest(const char *msg, size_t len, size_t step, char out[65]) {
+    static const char hex[] = "0123456789abcdef";
+    uint8_t d[SHA256_DIGEST_SIZE];
+    Sha256 h;
+    sha256_init(&h);
+    for (size_t off = 0; off < len; off += step)
+        sha256_update(&h, msg + off, len - off < step ? len - off : step);
+    sha256_final(&h, d);
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        out[2*i] = hex[d[i] >> 4];
+        out[2*i + 1] = hex[d[i] & 15];
+    }
+    out[64] = '\0';
+}
+
+int main(void) {
+    char out[65];
+    const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+    hex_digest("", 0, 1, out);
+    assert(strcmp(out, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") == 0);
+    hex_digest("abc", 3, 3, out);
+    assert(strcmp(out, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+
+    /* the padding spills into a second block; any split gives the same digest */
+    for (size_t step = 1; step <= 64; step++) {
+        hex_digest(two_blocks, strlen(two_blocks), step, out);
+        assert(strcmp(out, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0);
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#include "symbol_table.h"
+
+#define TRACE "test_stats_tmp.json"
+
+int main(void) {
+    Stats file, total;
+    stats_init(&file);
+    stats_init(&total);
+
+    /* nothing is counted until collection is turned on */
+    stats_bind(&file);
+    stats_count(STAT_LINES, 5);
+    assert(file.counters[STAT_LINES] == 0);
+
+    stats_enable(true);
+    file.tid = 2;
+    StatMark whole, mark;
+    stats_begin(&whole, 0);
+    stats_count(STAT_LINES, 5);
+
+    /* lookups and the probes they take, hits and misses alike */
+    Arena arena;
+    arena_init(&arena, 0);
+    SymbolTable st;
+    init_symbol_table(&st, &arena);
+    stats_begin(&mark, arena.allocated);
+    assert(add_symbol(&st, "MAIN", 100, SYM_CODE));
+    assert(find_symbol(&st, "MAIN") && !find_symbol(&st, "LOOP"));
+    stats_end(&mark, PHASE_FIRST_PASS, arena.allocated);
+    assert(file.counters[STAT_SYMBOL_LOOKUPS] == 3);
+    assert(file.counters[STAT_SYMBOL_PROBES] >= 3);
+    assert(file.bytes[PHASE_FIRST_PASS] > 0);
+    stats_file_done(&whole, "prog.as");
+    stats_bind(NULL);
+
+    stats_merge(&total, &file);
+    assert(total.files == 1 && total.counters[STAT_LINES] == 5);
+    assert(total.event_count == 2 && file.event_count == 0);
+
+    /* phases nest inside the file on the lane of its thread */
+    assert(stats_write_trace(&total, TRACE));
+    FILE *f = fopen(TRACE, "r");
+    assert(f);
+    char buf[2048];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    remove(TRACE);
+    assert(strstr(buf, "\"name\":\"first_pass\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":2"));
+    assert(strstr(buf, "\"name\":\"prog.as\",\"cat\":\"file\""));
+    assert(strstr(buf, "\"args\":{\"name\":\"worker 2\"}"));
+
+    free_symbol_table(&st);
+    arena_free(&arena);
+    stats_free(&file);
+    stats_free(&total);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "symbol_table.h"
+
+int main(void) {
+    Arena arena;
+    SymbolTable st;
+    arena_init(&arena, 0);
+    init_symbol_table(&st, &arena);
+
+    /* enough symbols to grow the index and span several blocks */
+    Symbol *first = add_symbol(&st, "S0", 0, SYM_CODE);
+    assert(first && first->id == 0);
+    for (int i = 1; i < 3 * SYMBOL_BLOCK; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "S%d", i);
+        Symbol *sym = add_symbol(&st, name, i, i % 2 ? SYM_DATA : SYM_CODE);
+        assert(sym && sym->id == i);
+    }
+    assert(symbol_count(&st) == 3 * SYMBOL_BLOCK);
+
+    /* pointers and ids survive growth; ids follow definition order */
+    assert(find_symbol(&st, "S0") == first);
+    assert(symbol_at(&st, 300)->address == 300);
+    assert(strcmp(symbol_at(&st, 300)->name, "S300") == 0);
+    assert(find_symbol(&st, "S767")->id == 767);
+    assert(find_symbol(&st, "S768") == NULL);
+
+    /* duplicates are rejected and leave the table unchanged */
+    assert(add_symbol(&st, "S5", 99, SYM_CODE) == NULL);
+    assert(find_symbol(&st, "S5")->address == 5);
+
+    relocate_data_symbols(&st, 100);
+    assert(find_symbol(&st, "S1")->address == 101);
+    assert(find_symbol(&st, "S2")->address == 2);
+
+    assert(update_symbol_type(&st, "S2", SYM_ENTRY));
+    assert(find_symbol(&st, "S2")->type == SYM_ENTRY);
+
+    free_symbol_table(&st);
+    assert(symbol_count(&st) == 0 && find_symbol(&st, "S0") == NULL);
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Build-time generator for keyword_table.h.
+ *
+ * Reads the keyword list from keywords.def and searches for a seed of
+ * keyword_slot() under which every keyword lands in a different slot of a
+ * KEYWORD_SLOTS table, then prints that table as C.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "keywords.h"
+
+typedef struct {
+    const char *name;
+    const char *kind;
+    const char *value;
+} Def;
+
+static const Def defs[] = {
+#define KEYWORD(name, kind, value) { #name, #kind, #value },
+#include "keywords.def"
+#undef KEYWORD
+};
+
+#define DEF_COUNT ((int)(sizeof(defs) / sizeof(defs[0])))
+
+/* Slot of every keyword under `seed`; false if two of them collide */
+static int place(uint32_t seed, int slot_of[DEF_COUNT]) {
+    unsigned char used[KEYWORD_SLOTS] = {0};
+    for (int i = 0; i < DEF_COUNT; i++) {
+        int slot = (int)keyword_slot(defs[i].name, strlen(defs[i].name), seed);
+        if (used[slot]) return 0;
+        used[slot] = 1;
+        slot_of[i] = slot;
+    }
+    return 1;
+}
+
+int main(void) {
+    int slot_of[DEF_COUNT];
+    uint32_t seed = 2166136261u;
+    size_t max_len = 0;
+
+    for (long tries = 0; !place(seed, slot_of); tries++, seed++) {
+        if (tries == 100000000) {
+            fprintf(stderr, "gen_keywords: no collision-free seed, raise KEYWORD_SLOT_BITS\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < DEF_COUNT; i++)
+        if (strlen(defs[i].name) > max_len) max_len = strlen(defs[i].name);
+
+    printf("/* Generated by tools/gen_keywords.c from keywords.def: do not edit */\n");
+    printf("#define KEYWORD_SEED    %uu\n", (unsigned)seed);
+    printf("#define KEYWORD_MAX_LEN %u\n\n", (unsigned)max_len);
+    printf("static const KeywordEntry keyword_table[KEYWORD_SLOTS] = {\n");
+    for (int i = 0; i < DEF_COUNT; i++)
+        printf("    [%2d] = { \"%s\", %u, %s, %s },\n", slot_of[i], defs[i].name,
+               (unsigned)strlen(defs[i].name), defs[i].kind, defs[i].value);
+    printf("};\n");
+    return 0;
+}
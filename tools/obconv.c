@@ -0,0 +1,40 @@
+/*
+ * Convert between the text object files (.ob with its .ent/.ext) and the
+ * binary .obj format (see objfile.h).  The direction follows the extension
+ * of each argument:
+ *
+ *     ./obconv prog.ob      writes prog.obj
+ *     ./obconv prog.obj     writes prog.ob, prog.ent and prog.ext
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "objfile.h"
+#include "utils.h"
+#include "error.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_error("Usage: %s <file.ob | file.obj> ...", argv[0]);
+        return 1;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *ext = strrchr(argv[i], '.');
+        char *base = strip_extension(argv[i]);
+        if (!base) error_exit("Memory allocation failed");
+        bool ok;
+        if (ext && strcmp(ext, ".ob") == 0) {
+            ok = objfile_from_text(base);
+        } else if (ext && strcmp(ext, ".obj") == 0) {
+            ok = objfile_to_text(base);
+        } else {
+            print_error("Not an object file: %s", argv[i]);
+            ok = false;
+        }
+        if (!ok) status = 1;
+        free(base);
+    }
+    return status;
+}
@@ -1,11 +1,18 @@
 // utils.c
+#define _POSIX_C_SOURCE 200809L
 #include "utils.h"
+#include "error.h"
+#include "keywords.h"
+#include "lexer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
-#include <strings.h>
 #include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 
 // Removes whitespace from the beginning and end of the string
 void trim_string(char* str) {
@@ -21,6 +28,16 @@ void trim_string(char* str) {
     }
 }
 
+// Narrows a (pointer, length) view to exclude surrounding whitespace
+void trim_view(const char** str, int* len) {
+    const char *s = *str;
+    int n = *len;
+    while (n > 0 && isspace((unsigned char)*s)) { s++; n--; }
+    while (n > 0 && isspace((unsigned char)s[n - 1])) n--;
+    *str = s;
+    *len = n;
+}
+
 // Returns true if the string is empty or contains only whitespace
 bool is_whitespace(const char* str) {
     while (*str) {
@@ -77,46 +94,16 @@ void to_upper_case(char* str) {
 // Returns true if the string matches an opcode mnemonic, directive, or register
 bool is_reserved_word(const char *s) {
     if (!s) return false;
-
-    static const char *opcodes[] = {
-        "MOV", "CMP", "ADD", "SUB", "LEA",
-        "CLR", "NOT", "INC", "DEC", "JMP",
-        "BNE", "JSR", "RED", "PRN", "RTS", "STOP",
-        NULL
-    };
-
-    static const char *directives[] = {
-        "DATA", "STRING", "MAT", "ENTRY", "EXTERN",
-        NULL
-    };
-
-    static const char *registers[] = {
-        "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
-        NULL
-    };
-
-    for (int i = 0; opcodes[i]; ++i)
-        if (strcasecmp(s, opcodes[i]) == 0)
-            return true;
-
-    for (int i = 0; directives[i]; ++i)
-        if (strcasecmp(s, directives[i]) == 0)
-            return true;
-
-    for (int i = 0; registers[i]; ++i)
-        if (strcasecmp(s, registers[i]) == 0)
-            return true;
-
-    return false;
+    return keyword_lookup_str(s).kind != KW_NONE;
 }
 
 // Returns true if the given string is a valid label name
 bool is_valid_label(const char* str) {
-    if (!str || !isalpha((unsigned char)str[0]))
+    if (!str || !(char_class[(unsigned char)str[0]] & CC_ALPHA))
         return false;
     int i = 1;
     while (str[i]) {
-        if (!isalnum((unsigned char)str[i]) && str[i] != '_')
+        if (!(char_class[(unsigned char)str[i]] & CC_IDENT))
             return false;
         i++;
     }
@@ -127,17 +114,17 @@ bool is_valid_label(const char* str) {
 
 // Converts a 16-bit word to a base-4 string representation
 void convert_to_base4(uint16_t value, char *out) {
-    char tmp[9];
     for (int i = 7; i >= 0; --i) {
-        tmp[i] = "0123"[value & 0x3];
+        out[i] = "0123"[value & 0x3];
         value >>= 2;
     }
-    tmp[8] = '\0';
-    strcpy(out, tmp);
+    out[8] = '\0';
 }
 
-// Prints an error message and exits the program
+// Prints an error message and exits the program (or, inside the library,
+// unwinds to the assembly that hit it)
 void error_exit(const char* msg) {
+    error_unwind(msg);
     fprintf(stderr, "Error: %s\n", msg);
     exit(EXIT_FAILURE);
 }
@@ -197,14 +184,89 @@ char *strcat_printf(const char *base, const char *suffix) {
     return res;
 }
 
-// Strip file extension from `filename` and return a static buffer.
-const char *strip_extension(const char *filename) {
-    static char buf[256];
+// Strip file extension from `filename` into a newly allocated string.
+// Returns NULL on allocation failure.
+char *strip_extension(const char *filename) {
     if (!filename) return NULL;
-    strncpy(buf, filename, sizeof(buf) - 1);
-    buf[sizeof(buf) - 1] = '\0';
+    size_t len = strlen(filename);
+    char *buf = malloc(len + 1);
+    if (!buf) return NULL;
+    memcpy(buf, filename, len + 1);
     char *dot = strrchr(buf, '.');
     if (dot) *dot = '\0';
     return buf;
 }
 
+bool parse_int(const char *str, int min, int max, int *out) {
+    char *end;
+    errno = 0;
+    long n = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || errno != 0 || n < min || n > max)
+        return false;
+    *out = (int)n;
+    return true;
+}
+
+// Threads worth splitting one large job across: $ASSEMBLER_THREADS if it is
+// set to a positive number, otherwise the number of online CPUs.
+int worker_thread_count(void) {
+    const char *env = getenv("ASSEMBLER_THREADS");
+    int n;
+    if (env && parse_int(env, 1, INT_MAX, &n)) return n;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// Files between worker_job_begin and worker_job_end
+static int active_jobs;
+static pthread_mutex_t active_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void worker_job_begin(void) {
+    pthread_mutex_lock(&active_lock);
+    active_jobs++;
+    pthread_mutex_unlock(&active_lock);
+}
+
+void worker_job_end(void) {
+    pthread_mutex_lock(&active_lock);
+    active_jobs--;
+    pthread_mutex_unlock(&active_lock);
+}
+
+int split_count(long long items, long long min_per_piece, int max_pieces) {
+    long long n = items / min_per_piece;
+    pthread_mutex_lock(&active_lock);
+    int jobs = active_jobs > 1 ? active_jobs : 1;
+    pthread_mutex_unlock(&active_lock);
+    int cpus = worker_thread_count() / jobs;
+    if (n > cpus) n = cpus;
+    if (n > max_pieces) n = max_pieces;
+    return (int)n;
+}
+
+typedef struct {
+    void (*fn)(void *ctx, int i);
+    void *ctx;
+    int   i;
+} SplitPiece;
+
+static void *split_piece(void *arg) {
+    SplitPiece *p = arg;
+    p->fn(p->ctx, p->i);
+    return NULL;
+}
+
+void run_split(int n, void (*fn)(void *ctx, int i), void *ctx) {
+    SplitPiece pieces[MAX_SPLIT];
+    pthread_t threads[MAX_SPLIT];
+    bool started[MAX_SPLIT] = { false };
+    for (int i = 1; i < n; i++) {
+        pieces[i] = (SplitPiece){ fn, ctx, i };
+        started[i] = pthread_create(&threads[i], NULL, split_piece, &pieces[i]) == 0;
+    }
+    fn(ctx, 0);
+    for (int i = 1; i < n; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else fn(ctx, i);
+    }
+}
@@ -8,6 +8,10 @@
 // Removes whitespace from the beginning and end of the string (in place)
 void trim_string(char* str);
 
+// Narrows the view [*str, *str + *len) so it excludes leading and trailing
+// whitespace. The underlying bytes are not modified.
+void trim_view(const char** str, int* len);
+
 // Returns true if the string is empty or contains only whitespace
 bool is_whitespace(const char* str);
 
@@ -30,7 +34,8 @@ bool is_valid_label(const char* str);
 // Converts a 16-bit word to base-4 string (8 digits, null-terminated)
 void convert_to_base4(uint16_t value, char *out);
 
-// Prints an error message and exits the program
+// Prints an error message and exits the program. If the calling thread's
+// error sink has a recovery point, unwinds there instead (see error_unwind).
 void error_exit(const char* msg);
 
 // Replace all occurrences of substring `old` in `src` with `new`.
@@ -43,8 +48,36 @@ char *replace_substring(const char *src, const char *old, const char *new_sub);
 // allocation failure.
 char *strcat_printf(const char *base, const char *suffix);
 
-// Return a copy of `filename` without its extension. The returned pointer
-// refers to a static buffer that is overwritten on each call.
-const char *strip_extension(const char *filename);
+// Return a copy of `filename` without its extension. The caller owns the
+// returned string and must free it. Returns NULL on allocation failure.
+char *strip_extension(const char *filename);
+
+// Parse all of `str` as a decimal int in [min, max] into *out. Returns
+// false, leaving *out alone, on trailing characters or a value out of range.
+bool parse_int(const char *str, int min, int max, int *out);
+
+// Threads worth splitting one large job across: $ASSEMBLER_THREADS if it is
+// set to a positive number, otherwise the number of online CPUs.
+int worker_thread_count(void);
+
+// A file's passes are split across threads once it has this many lines per
+// thread, into at most MAX_SPLIT pieces
+#define PARALLEL_MIN_LINES (1 << 15)
+#define MAX_SPLIT          16
+
+// Bracket one file of a batch or daemon request.  The files being
+// assembled at once share worker_thread_count() between them.
+void worker_job_begin(void);
+void worker_job_end(void);
+
+// Pieces to split `items` into so each has at least `min_per_piece`, capped
+// by this file's share of worker_thread_count() and `max_pieces`
+// (<= MAX_SPLIT).  Below 2 the job is better done in one piece.
+int split_count(long long items, long long min_per_piece, int max_pieces);
+
+// Call fn(ctx, i) for every i in [0, n), n <= MAX_SPLIT: piece 0 on the
+// calling thread and each other piece on a thread of its own, or on the
+// calling thread if that thread can't be started.  Returns once all are done.
+void run_split(int n, void (*fn)(void *ctx, int i), void *ctx);
 
 #endif // UTILS_H